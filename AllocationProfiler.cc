@@ -0,0 +1,200 @@
+#include "AllocationProfiler.h"
+#include "Object.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <typeinfo>
+
+#if defined(__GLIBC__)
+#include <execinfo.h>
+#define NORLIT_HAS_BACKTRACE 1
+#endif
+
+#if defined(__GNUC__)
+#include <cxxabi.h>
+#endif
+
+using namespace norlit::gc;
+
+bool AllocationProfiler::enabled = false;
+size_t AllocationProfiler::interval = 0;
+size_t AllocationProfiler::bytes_until_sample = SIZE_MAX;
+std::vector<AllocationProfiler::Sample> AllocationProfiler::samples;
+size_t AllocationProfiler::resolved = 0;
+
+namespace {
+
+std::mt19937_64& Random() {
+    static std::mt19937_64 random{ std::random_device{}() };
+    return random;
+}
+
+std::string Demangle(const char* name) {
+#if defined(__GNUC__)
+    int status;
+    char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if (demangled) {
+        std::string ret = demangled;
+        free(demangled);
+        return ret;
+    }
+#endif
+    return name;
+}
+
+// Extract function name from a backtrace_symbols entry like "binary(symbol+0x10) [0x1234]".
+// For frames without symbol, "binary+0x10" is used instead
+std::string FrameName(const char* symbol) {
+    const char* begin = strchr(symbol, '(');
+    const char* end = begin ? strchr(begin, ')') : nullptr;
+    if (!begin || !end) {
+        return symbol;
+    }
+    const char* offset = std::find(begin, end, '+');
+    if (offset != begin + 1) {
+        return Demangle(std::string(begin + 1, offset).c_str());
+    }
+    std::string path(symbol, begin);
+    size_t slash = path.rfind('/');
+    return path.substr(slash == std::string::npos ? 0 : slash + 1) + std::string(offset, end);
+}
+
+bool IsAllocatorFrame(const std::string& name) {
+    static const char* const prefixes[] = {
+        "norlit::gc::AllocationProfiler::",
+        "norlit::gc::Heap::",
+        "norlit::gc::Object::operator new"
+    };
+    for (const char* prefix : prefixes) {
+        if (name.compare(0, strlen(prefix), prefix) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+void AllocationProfiler::Start(size_t newInterval) {
+    enabled = true;
+    interval = newInterval ? newInterval : 1;
+    NextSample();
+}
+
+void AllocationProfiler::Stop() {
+    enabled = false;
+    bytes_until_sample = SIZE_MAX;
+}
+
+bool AllocationProfiler::IsEnabled() {
+    return enabled;
+}
+
+void AllocationProfiler::Clear() {
+    samples.clear();
+    resolved = 0;
+}
+
+void AllocationProfiler::NextSample() {
+    // Intervals between samples are exponentially distributed, so every
+    // byte has the same chance to be sampled
+    std::exponential_distribution<double> distribution{ 1.0 / interval };
+    bytes_until_sample = static_cast<size_t>(distribution(Random())) + 1;
+}
+
+void AllocationProfiler::Record(Object* object, size_t size) {
+    samples.emplace_back();
+    Sample& sample = samples.back();
+    sample.object = object;
+    sample.type = nullptr;
+    sample.size = size;
+    sample.survived = 0;
+#ifdef NORLIT_HAS_BACKTRACE
+    sample.depth = backtrace(sample.frames, kMaxFrames);
+#else
+    sample.depth = 0;
+#endif
+    NextSample();
+}
+
+void AllocationProfiler::ResolveTypes() {
+    for (; resolved < samples.size(); resolved++) {
+        Sample& sample = samples[resolved];
+        if (sample.object) {
+            sample.type = typeid(*sample.object).name();
+        }
+    }
+}
+
+void AllocationProfiler::UpdateLocations() {
+    // Called by GC after move targets are calculated and before objects are moved
+    for (Sample& sample : samples) {
+        if (sample.object) {
+            sample.object = sample.object->dest_;
+            if (sample.object) {
+                sample.survived++;
+            }
+        }
+    }
+}
+
+void AllocationProfiler::RegionExited() {
+    ResolveTypes();
+    for (Sample& sample : samples) {
+        if (sample.object && sample.object->space_ == Space::REGION_SPACE &&
+                sample.object->status_ != Status::MARKED) {
+            sample.object = nullptr;
+        }
+    }
+}
+
+void AllocationProfiler::Moved(Object* from, Object* to) {
+    for (Sample& sample : samples) {
+        if (sample.object == from) {
+            sample.object = to;
+        }
+    }
+}
+
+void AllocationProfiler::WriteFolded(FILE* file, bool live) {
+    ResolveTypes();
+
+    // Merge identical stacks, and estimate the allocated bytes each sample represents
+    std::map<std::string, double> stacks;
+    for (Sample& sample : samples) {
+        if (live && !sample.object) {
+            continue;
+        }
+        std::string stack;
+#ifdef NORLIT_HAS_BACKTRACE
+        char** symbols = backtrace_symbols(sample.frames, sample.depth);
+        std::vector<std::string> names;
+        for (uint32_t i = 0; i < sample.depth; i++) {
+            names.push_back(symbols ? FrameName(symbols[i]) : "??");
+        }
+        free(symbols);
+        // Skip the innermost frames inside the profiler and heap
+        size_t first = 0;
+        while (first < names.size() && IsAllocatorFrame(names[first])) {
+            first++;
+        }
+        // Outermost frame first
+        for (size_t i = names.size(); i-- > first;) {
+            stack += names[i];
+            stack += ';';
+        }
+#endif
+        stack += sample.type ? Demangle(sample.type) : "?";
+        double probability = 1 - std::exp(-static_cast<double>(sample.size) / interval);
+        stacks[stack] += sample.size / probability;
+    }
+
+    for (auto& entry : stacks) {
+        fprintf(file, "%s %llu\n", entry.first.c_str(), static_cast<unsigned long long>(entry.second));
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef NORLIT_GC_ALLOCATIONPROFILER_H
+#define NORLIT_GC_ALLOCATIONPROFILER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+namespace norlit {
+namespace gc {
+
+class Object;
+
+// Samples heap allocations at an average interval of bytes (Poisson sampling),
+// recording size, type and call stack of sampled objects, and tracks whether
+// they survive subsequent GCs.
+class AllocationProfiler {
+    static const size_t kMaxFrames = 32;
+
+    struct Sample {
+        // Current location of the object, nullptr if collected
+        Object* object;
+        // Resolved before the first GC after allocation, when the object is fully constructed
+        const char* type;
+        size_t size;
+        // Number of GCs the object survived
+        uint32_t survived;
+        uint32_t depth;
+        void* frames[kMaxFrames];
+    };
+
+    static bool enabled;
+    static size_t interval;
+    // Bytes to be allocated before the next sample is taken
+    static size_t bytes_until_sample;
+    static std::vector<Sample> samples;
+    // Samples before this index have types resolved
+    static size_t resolved;
+
+    static void NextSample();
+    static void Record(Object* object, size_t size);
+    static void ResolveTypes();
+    static void UpdateLocations();
+    // Called when a large object is moved outside of GC
+    static void Moved(Object* from, Object* to);
+    // Called when a region ends, after surviving objects are marked and before the
+    // rest are destroyed
+    static void RegionExited();
+
+    // Called in Heap::Allocate. Near zero cost when disabled, since
+    // bytes_until_sample is then always larger than size
+    static void Allocated(void* object, size_t size) {
+        if (bytes_until_sample > size) {
+            bytes_until_sample -= size;
+        } else {
+            Record(static_cast<Object*>(object), size);
+        }
+    }
+
+  public:
+    // Start sampling, on average once every interval bytes
+    static void Start(size_t interval = 512 * 1024);
+    static void Stop();
+    static bool IsEnabled();
+    // Discard all samples
+    static void Clear();
+
+    // Write samples in folded stack format ("frame;frame;type bytes" per line),
+    // as consumed by flame graph tools. Bytes are estimated total allocation
+    // represented by the samples. If live is true, only samples whose objects
+    // are still alive are written
+    static void WriteFolded(FILE* file, bool live = false);
+
+    friend class Heap;
+};
+
+}
+}
+
+#endif
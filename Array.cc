@@ -1,5 +1,8 @@
 #include "Array.h"
 
+#include <cstring>
+#include <vector>
+
 using namespace norlit::gc;
 using namespace norlit::gc::detail;
 
@@ -17,8 +20,42 @@ ArrayBase::ArrayBase(size_t length) :length(length) {
     }
 }
 
+void ArrayBase::CopyRange(size_t index, ArrayBase* src, size_t from, size_t count) {
+    assert(index + count <= length && from + count <= src->length);
+    PutRange(index, &src->slots[from], count);
+}
+
+void ArrayBase::InsertRange(size_t index, ArrayBase* src, size_t from, size_t count) {
+    assert(index + count <= length && from + count <= src->length);
+    if (src == this) {
+        // Source is moved by the shift below, so take a copy first. No GC can
+        // happen until it is stored back
+        std::vector<Object*> copy(&slots[from], &slots[from + count]);
+        InsertRange(index, copy.data(), count);
+        return;
+    }
+    InsertRange(index, &src->slots[from], count);
+}
+
+void ArrayBase::InsertRange(size_t index, Object* const* data, size_t count) {
+    // Drop elements moved past the end
+    FillRange(length - count, nullptr, count);
+    // Moving within the array keeps the same set of references, so it needs no barrier
+    memmove(&slots[index + count], &slots[index], (length - count - index) * sizeof(Object*));
+    memset(&slots[index], 0, count * sizeof(Object*));
+    PutRange(index, data, count);
+}
+
 void ArrayBase::IterateField(const FieldIterator& iter) {
     for (size_t i = 0; i < length; i++) {
         iter(&slots[i]);
     }
+}
+
+size_t ArrayBase::IterateFieldSlice(const FieldIterator& iter, size_t begin, size_t count) {
+    size_t end = length - begin > count ? begin + count : length;
+    for (size_t i = begin; i < end; i++) {
+        iter(&slots[i]);
+    }
+    return end == length ? 0 : end;
 }
\ No newline at end of file
@@ -3,11 +3,17 @@
 
 #include "Object.h"
 #include "Handle.h"
+#include "Heap.h"
+
+#include <algorithm>
 #include <new>
+#include <stdexcept>
 
 namespace norlit {
 namespace gc {
 namespace detail {
+class VectorBase;
+
 class ArrayBase: public Object {
     size_t length;
     Object* slots[1];
@@ -19,10 +25,32 @@ class ArrayBase: public Object {
 
     ArrayBase(size_t length);
 
+    // Size of an array object holding length references
+    static size_t SizeOf(size_t length) {
+        return sizeof(ArrayBase) + sizeof(Object*) * (length - 1);
+    }
+
     void Put(size_t index, Object* obj) {
         WriteBarrier(&slots[index], obj);
     }
 
+    // Store count references from data starting at index
+    void PutRange(size_t index, Object* const* data, size_t count) {
+        CopyWriteBarrier(&slots[index], data, count);
+    }
+
+    void FillRange(size_t index, Object* obj, size_t count) {
+        FillWriteBarrier(&slots[index], obj, count);
+    }
+
+    void CopyRange(size_t index, ArrayBase* src, size_t from, size_t count);
+    void InsertRange(size_t index, ArrayBase* src, size_t from, size_t count);
+    void InsertRange(size_t index, Object* const* data, size_t count);
+
+    Object** Slots() {
+        return slots;
+    }
+
     Object* Get(size_t index) {
         return slots[index];
     }
@@ -32,6 +60,9 @@ class ArrayBase: public Object {
     }
 
     virtual void IterateField(const FieldIterator&) override;
+    virtual size_t IterateFieldSlice(const FieldIterator&, size_t begin, size_t count) override;
+
+    friend class VectorBase;
 };
 }
 
@@ -87,15 +118,77 @@ class Array : public detail::ArrayBase {
         return{ this };
     }
 
+    // Bulk operations run the write barrier once for the whole range, instead of
+    // once per element as Put does
+
+    // Copy count elements of src starting at from to index. src may be this array
+    void CopyRange(size_t index, const Handle<Array>& src, size_t from, size_t count) {
+        ArrayBase::CopyRange(index, src, from, count);
+    }
+
+    // Store count elements of src starting at from to index, moving elements at
+    // index onwards towards the end. Elements moved past the end are dropped
+    void InsertRange(size_t index, const Handle<Array>& src, size_t from, size_t count) {
+        ArrayBase::InsertRange(index, src, from, count);
+    }
+
+    void Fill(const Handle<T>& obj) {
+        FillRange(0, obj, Length());
+    }
+
+    void Fill(size_t index, size_t count, const Handle<T>& obj) {
+        FillRange(index, obj, count);
+    }
+
+    // Sort count elements from index with less(T*, T*). Elements are only permuted,
+    // so no barrier is needed. GC is disabled meanwhile, so less may allocate
+    template<typename Compare>
+    void Sort(size_t index, size_t count, Compare less) {
+        NoGC noGC;
+        T** begin = reinterpret_cast<T**>(Slots()) + index;
+        std::sort(begin, begin + count, less);
+    }
+
+    template<typename Compare>
+    void Sort(Compare less) {
+        Sort(0, Length(), less);
+    }
+
     static Handle<Array> New(size_t length) {
         return new(length, false)Array(length);
     }
+
+    // Create an array directly in tenured space, as Heap::NewTenured does
+    static Handle<Array> NewTenured(size_t length) {
+        Heap::allocating_tenured = true;
+        Array* array = new(length, false)Array(length);
+        Heap::FinishTenuredAllocation(array);
+        return array;
+    }
+
+    // Create an array with every element set to obj
+    static Handle<Array> New(size_t length, const Handle<T>& obj) {
+        Handle<Array> array = new(length, false)Array(length);
+        array->Fill(obj);
+        return array;
+    }
+
+    // Create an array holding count elements of src starting at from
+    static Handle<Array> New(const Handle<Array>& src, size_t from, size_t count) {
+        Handle<Array> array = new(count, false)Array(count);
+        array->CopyRange(0, src, from, count);
+        return array;
+    }
 };
 
 template<typename T>
 class ValueArray : public Object {
     size_t length;
     char slots[1];
+
+    // Offset of slots, which Heap aligns for NewPinned. Derived members follow the
+    // Object header, which is a multiple of 8 bytes
+    static const size_t kSlotsOffset = sizeof(Object) + sizeof(size_t);
   protected:
     static void* operator new(size_t size) = delete;
     static void* operator new(size_t size, size_t length, bool) {
@@ -107,6 +200,7 @@ class ValueArray : public Object {
     using Object::operator delete;
 
     ValueArray(size_t length) :length(length) {
+        assert(static_cast<size_t>(reinterpret_cast<char*>(slots) - reinterpret_cast<char*>(this)) == kSlotsOffset);
         for (size_t i = 0; i < length; i++) {
             new(&At(i)) T();
         }
@@ -123,6 +217,11 @@ class ValueArray : public Object {
         return reinterpret_cast<T*>(slots)[index];
     }
 
+    // Only valid as long as the array is not moved, i.e. for pinned arrays
+    T* Data() {
+        return reinterpret_cast<T*>(slots);
+    }
+
     size_t Length() {
         return length;
     }
@@ -130,6 +229,27 @@ class ValueArray : public Object {
     static Handle<ValueArray> New(size_t length) {
         return new(length, false) ValueArray(length);
     }
+
+    // Create an array directly in tenured space, as Heap::NewTenured does
+    static Handle<ValueArray> NewTenured(size_t length) {
+        Heap::allocating_tenured = true;
+        ValueArray* array = new(length, false) ValueArray(length);
+        Heap::FinishTenuredAllocation(array);
+        return array;
+    }
+
+    // Create an array that is never moved, so Data() can be handed to system calls
+    // such as read or writev. Data() is aligned to alignment, which must be a power
+    // of two no larger than a page, e.g. 64 for SIMD loads or the block size for O_DIRECT
+    static Handle<ValueArray> NewPinned(size_t length, size_t alignment = alignof(T)) {
+        if (!alignment || (alignment & (alignment - 1))) {
+            throw std::invalid_argument{ "Alignment must be a power of two" };
+        }
+        Heap::allocating_pinned = true;
+        Heap::allocating_alignment = alignment;
+        Heap::allocating_alignment_offset = kSlotsOffset;
+        return new(length, false) ValueArray(length);
+    }
 };
 
 
@@ -2,13 +2,24 @@
 #include "debug.h"
 
 #include "Heap.h"
+#include "AllocationProfiler.h"
+#include "Handle.h"
 #include "MemorySpace.h"
 #include "Platform.h"
 
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <stdexcept>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <typeinfo>
+#include <vector>
 
 using namespace norlit::gc;
 
@@ -19,12 +30,27 @@ struct Heap::MarkingIterator : public FieldIterator {
             return;
         }
         assert(obj->space_ != Space::STACK_SPACE);
-        if (obj->status_ == Status::NOT_MARKED) {
-            obj->status_ = Status::MARKING;
+        // Immortal objects are never collected. Leave them untouched so image pages stay
+        // shared, and status_ keeps flagging remembered set membership
+        if (obj->status_ == Status::NOT_MARKED && obj->space_ != Space::IMMORTAL_SPACE) {
+            MarkObject(obj);
         }
     }
 
     virtual void operator()(Object** field, decltype(weak)) const {}
+
+    // SoftReference only reports soft fields when they should be kept
+    virtual void operator()(Object** field, decltype(soft)) const {
+        operator()(field);
+    }
+
+    virtual void operator()(Object** field, decltype(hot)) const {
+        size_t size = mark_worklist.size();
+        operator()(field);
+        if (mark_worklist.size() != size) {
+            mark_hot_entry = size;
+        }
+    }
 };
 
 struct Heap::UpdateIterator : public FieldIterator {
@@ -35,7 +61,11 @@ struct Heap::UpdateIterator : public FieldIterator {
         }
         assert(obj->space_ != Space::STACK_SPACE);
         assert(obj->dest_);
-        *field = obj->dest_;
+        // Avoid writing unchanged references, which would unshare image pages or
+        // fault on frozen ones
+        if (obj->dest_ != obj) {
+            *field = obj->dest_;
+        }
     }
 
     virtual void operator()(Object** field, decltype(weak)) const {
@@ -53,7 +83,14 @@ struct Heap::IncRefIterator : public FieldIterator {
         obj->IncRefCount();
     }
 
-    virtual void operator()(Object** field, decltype(weak)) const {}
+    // The write barrier cannot tell weak slots apart, so they are counted as well.
+    // Weak slots of objects promoted by GC may point at objects that died in it,
+    // which are left to weak reference notification
+    virtual void operator()(Object** field, decltype(weak)) const {
+        if (!IsDead(*field)) {
+            operator()(field);
+        }
+    }
 };
 
 struct Heap::DecRefIterator : public FieldIterator {
@@ -66,7 +103,11 @@ struct Heap::DecRefIterator : public FieldIterator {
         obj->DecRefCount();
     }
 
-    virtual void operator()(Object** field, decltype(weak)) const {}
+    virtual void operator()(Object** field, decltype(weak)) const {
+        if (!IsDead(*field)) {
+            operator()(field);
+        }
+    }
 };
 
 struct Heap::WeakRefNotifyIterator : public FieldIterator {
@@ -92,6 +133,216 @@ struct Heap::WeakRefNotifyIterator : public FieldIterator {
     }
 };
 
+// Used by mixed GC to discount references from the collection set to young objects
+// and to the collection set itself, so remaining reference counts only come from
+// outside and objects with non-zero count are roots
+struct Heap::TrialDecRefIterator : public FieldIterator {
+    virtual void operator()(Object** field) const {
+        Object* obj = *field;
+        if (!obj || obj->IsTagged()) {
+            return;
+        }
+        if (obj->space_ == Space::EDEN_SPACE || obj->space_ == Space::SURVIVOR_SPACE || InCollectionSet(obj)) {
+            obj->DecRefCount();
+        }
+    }
+
+    virtual void operator()(Object** field, decltype(weak)) const {
+        operator()(field);
+    }
+};
+
+// Undo TrialDecRefIterator for surviving objects of the collection set
+struct Heap::TrialIncRefIterator : public FieldIterator {
+    virtual void operator()(Object** field) const {
+        Object* obj = *field;
+        if (!obj || obj->IsTagged()) {
+            return;
+        }
+        if (obj->space_ == Space::EDEN_SPACE || obj->space_ == Space::SURVIVOR_SPACE || InCollectionSet(obj)) {
+            obj->IncRefCount();
+        }
+    }
+
+    virtual void operator()(Object** field, decltype(weak)) const {
+        operator()(field);
+    }
+};
+
+// For collected objects of the collection set, decrease the references that
+// TrialDecRefIterator did not
+struct Heap::DeadDecRefIterator : public FieldIterator {
+    virtual void operator()(Object** field) const {
+        Object* obj = *field;
+        if (!obj || obj->IsTagged()) {
+            return;
+        }
+        if (obj->space_ != Space::EDEN_SPACE && obj->space_ != Space::SURVIVOR_SPACE && !InCollectionSet(obj)) {
+            obj->DecRefCount();
+        }
+    }
+
+    virtual void operator()(Object** field, decltype(weak)) const {
+        operator()(field);
+    }
+};
+
+// Estimates garbage in tenured space by trial deletion: objects whose reference
+// count drops to zero when counts from other candidates are removed are candidates
+// as well. Run again with restore set to undo the changes. Counts are changed
+// directly, so objects are not recorded as unreferenced
+struct Heap::GarbageEstimateIterator : public FieldIterator {
+    std::vector<Object*>& candidates;
+    bool restore;
+
+    GarbageEstimateIterator(std::vector<Object*>& candidates, bool restore)
+        :candidates(candidates), restore(restore) {}
+
+    virtual void operator()(Object** field) const {
+        Object* obj = *field;
+        if (!obj || obj->IsTagged() || obj->space_ != Space::TENURED_SPACE) {
+            return;
+        }
+        if (restore) {
+            obj->refcount_++;
+        } else {
+            obj->refcount_--;
+            if (!obj->refcount_ && !obj->estimated_) {
+                obj->estimated_ = true;
+                candidates.push_back(obj);
+            }
+        }
+    }
+
+    virtual void operator()(Object** field, decltype(weak)) const {
+        operator()(field);
+    }
+};
+
+// Find out whether an object references anything that is not immortal
+struct Heap::MortalReferenceIterator : public FieldIterator {
+    bool& found;
+
+    MortalReferenceIterator(bool& found) :found(found) {}
+
+    virtual void operator()(Object** field) const {
+        Object* obj = *field;
+        if (obj && !obj->IsTagged() && obj->space_ != Space::IMMORTAL_SPACE) {
+            found = true;
+        }
+    }
+
+    virtual void operator()(Object** field, decltype(weak)) const {
+        operator()(field);
+    }
+};
+
+// Used when a region ends to discount references between region objects, so
+// remaining reference counts only come from outside. Run again with restore set
+// for surviving objects
+struct Heap::RegionTrialIterator : public FieldIterator {
+    bool restore;
+
+    RegionTrialIterator(bool restore) :restore(restore) {}
+
+    virtual void operator()(Object** field) const {
+        Object* obj = *field;
+        if (!obj || obj->IsTagged() || obj->space_ != Space::REGION_SPACE) {
+            return;
+        }
+        if (restore) {
+            obj->IncRefCount();
+        } else {
+            obj->DecRefCount();
+        }
+    }
+
+    virtual void operator()(Object** field, decltype(weak)) const {
+        operator()(field);
+    }
+};
+
+// For region objects freed with the region, decrease the references that
+// RegionTrialIterator did not
+struct Heap::RegionDeadDecRefIterator : public FieldIterator {
+    virtual void operator()(Object** field) const {
+        Object* obj = *field;
+        if (obj && !obj->IsTagged() && obj->space_ != Space::REGION_SPACE) {
+            obj->DecRefCount();
+        }
+    }
+
+    virtual void operator()(Object** field, decltype(weak)) const {
+        operator()(field);
+    }
+};
+
+// Flags region objects reachable from escaped ones as escaped. Soft references
+// keep region objects alive as strong ones do
+struct Heap::RegionEscapeIterator : public FieldIterator {
+    std::vector<Object*>& escaped;
+
+    RegionEscapeIterator(std::vector<Object*>& escaped) :escaped(escaped) {}
+
+    virtual void operator()(Object** field) const {
+        Object* obj = *field;
+        if (obj && !obj->IsTagged() && obj->space_ == Space::REGION_SPACE && obj->status_ != Status::MARKED) {
+            obj->status_ = Status::MARKED;
+            escaped.push_back(obj);
+        }
+    }
+
+    virtual void operator()(Object** field, decltype(weak)) const {}
+
+    virtual void operator()(Object** field, decltype(soft)) const {
+        operator()(field);
+    }
+};
+
+// Weak references into a region that ends. Without restore set, discounts them
+// from the counts of region objects if the holder is counted. With restore set,
+// counts them again if the region object survives, or clears and notifies them
+// otherwise
+struct Heap::RegionWeakIterator : public FieldIterator {
+    Object* holder;
+    bool counted;
+    bool restore;
+
+    RegionWeakIterator(Object* holder, bool counted, bool restore)
+        :holder(holder), counted(counted), restore(restore) {}
+
+    virtual void operator()(Object** field) const {}
+
+    virtual void operator()(Object** field, decltype(weak)) const {
+        Object* obj = *field;
+        if (!obj || obj->IsTagged() || obj->space_ != Space::REGION_SPACE) {
+            return;
+        }
+        if (!restore) {
+            if (counted) {
+                obj->DecRefCount();
+            }
+        } else if (obj->status_ == Status::MARKED) {
+            if (counted) {
+                obj->IncRefCount();
+            }
+        } else {
+            *field = nullptr;
+            holder->NotifyWeakReferenceCollected(field);
+        }
+    }
+
+    virtual void operator()(Object** field, decltype(soft)) const {}
+};
+
+// Takes the place of a dead object that cannot be compacted away yet, in chunks
+// holding pinned objects and in chunks of ended regions. It has no fields, and
+// walkers skip it
+class Heap::Filler : public Object {
+  public:
+    Filler() :Object(NoInitialize{}) {}
+};
+
 // In order to make MemorySpace implementation simple and Object-detail free,
 // we make the walker part of implementation of Heap.
 // The heap uses Java-style iterator model with a glue layer make it work with
@@ -158,6 +409,19 @@ class Heap::StackSpaceIterator {
 
 };
 
+class Heap::RememberedSetIterator {
+    size_t index = 0;
+
+  public:
+    bool HasNext() {
+        return index < remembered_count;
+    }
+
+    Object* Next() {
+        return remembered_set[index++];
+    }
+};
+
 class Heap::LargeObjectSpaceIterator {
     // Use of prefetch here allows node to be deleted during iteration
     LargeObjectNode* current;
@@ -183,11 +447,77 @@ class Heap::LargeObjectSpaceIterator {
     void Remove() {
         current->prev->next = next;
         next->prev = current->prev;
-        Platform::Free(current, sizeof(LargeObjectNode) + reinterpret_cast<Object*>(current + 1)->size_);
+        Object* object = reinterpret_cast<Object*>(current + 1);
+        large_object_index.erase(std::lower_bound(large_object_index.begin(), large_object_index.end(), object));
+        size_t size = object->size_;
+        large_object_size -= size;
+        // Aligned pinned objects do not start their mapping
+        char* memory = reinterpret_cast<char*>(reinterpret_cast<uintptr_t>(current) &~(Platform::PageSize() - 1));
+        Platform::Free(memory, reinterpret_cast<char*>(current) - memory + sizeof(LargeObjectNode) + size);
         current = nullptr;
     }
 };
 
+// Accumulates time elapsed since last call to the phase
+class Heap::PhaseTimer {
+    GCEvent& event;
+    double last;
+
+  public:
+    PhaseTimer(GCEvent& event) :event(event), last(Now()) {}
+
+    void operator()(GCPhase phase) {
+        double now = Now();
+        event.phase_time[static_cast<size_t>(phase)] += now - last;
+        last = now;
+    }
+};
+
+// Least squares fit of pause = a * x0 + b * x1, with older samples decaying
+// so the model follows changes in program behaviour
+class Heap::CostModel {
+    static constexpr double kDecay = 0.7;
+    double xx00 = 0;
+    double xx01 = 0;
+    double xx11 = 0;
+    double xy0 = 0;
+    double xy1 = 0;
+    double a = 0;
+    double b = 0;
+
+  public:
+    void Add(double x0, double x1, double y) {
+        xx00 = xx00 * kDecay + x0 * x0;
+        xx01 = xx01 * kDecay + x0 * x1;
+        xx11 = xx11 * kDecay + x1 * x1;
+        xy0 = xy0 * kDecay + x0 * y;
+        xy1 = xy1 * kDecay + x1 * y;
+
+        double det = xx00 * xx11 - xx01 * xx01;
+        if (det > 1e-3 * xx00 * xx11) {
+            a = (xy0 * xx11 - xy1 * xx01) / det;
+            b = (xy1 * xx00 - xy0 * xx01) / det;
+        } else {
+            a = -1;
+        }
+        // x0 and x1 are usually correlated, e.g. when survival rate is stable,
+        // and the fit may be meaningless. Fall back to x0 alone
+        if (a < 0 || b < 0) {
+            a = xx00 > 0 ? xy0 / xx00 : 0;
+            b = 0;
+        }
+    }
+
+    double Predict(double x0, double x1) const {
+        return a * x0 + b * x1;
+    }
+
+    // No sample is added yet, so predictions are meaningless
+    bool Empty() const {
+        return xx00 == 0;
+    }
+};
+
 template<typename T>
 class Heap::Iterable {
     T t;
@@ -216,7 +546,10 @@ class Heap::Iterable {
     }
 };
 
+HeapConfig Heap::config;
 bool Heap::initialized = false;
+// Must outlive stack_space, whose destructor frees large objects
+std::vector<Object*> Heap::large_object_index;
 Object Heap::stack_space{};
 Heap::LargeObjectNode Heap::large_object_space{
     &large_object_space,
@@ -226,22 +559,80 @@ MemorySpace* Heap::eden_space;
 MemorySpace* Heap::survivor_from_space;
 MemorySpace* Heap::survivor_to_space;
 MemorySpace* Heap::tenured_space;
+MemorySpace* Heap::collection_set = nullptr;
+std::vector<MemorySpace*> Heap::collection_set_chunks;
+bool Heap::mixed_exhausted = false;
+MemorySpace* Heap::immortal_space = nullptr;
+MemorySpace* Heap::frozen_space = nullptr;
+MemorySpace* Heap::region_space = nullptr;
+MemorySpace* Heap::region_pool = nullptr;
+uintptr_t Heap::region_depth = 0;
+std::vector<Heap::MarkEntry> Heap::mark_worklist;
+size_t Heap::mark_hot_entry = 0;
+std::vector<Object*> Heap::copy_order;
+const size_t Heap::kMarkSliceSize;
+const size_t Heap::kDumpPieceSize;
+Object** Heap::remembered_set = nullptr;
+size_t Heap::remembered_count = 0;
+size_t Heap::remembered_capacity = 0;
+Object** Heap::external_set = nullptr;
+size_t Heap::external_count = 0;
+size_t Heap::external_capacity = 0;
+Object** Heap::unreferenced_set = nullptr;
+size_t Heap::unreferenced_count = 0;
+size_t Heap::unreferenced_capacity = 0;
+bool Heap::collecting = false;
+std::vector<Object*> Heap::region_referrers;
 uint32_t Heap::allocating_size = 0;
 void* Heap::allocating_object = 0;
-bool Heap::full_gc_suggested = false;
+uint8_t Heap::allocating_site = 0;
+bool Heap::allocating_tenured = false;
+bool Heap::allocating_immortal = false;
+bool Heap::allocating_pinned = false;
+size_t Heap::allocating_alignment = 0;
+size_t Heap::allocating_alignment_offset = 0;
+bool Heap::allocating_region = false;
+size_t Heap::pinned_count = 0;
+// Site 0 is reserved for untracked objects
+Heap::AllocationSite Heap::allocation_sites[kMaxAllocationSite];
+size_t Heap::allocation_site_count = 1;
 uintptr_t Heap::no_gc_counter = 0;
+double Heap::last_gc_end = 0;
+HeapStatistics Heap::statistics;
+double Heap::last_release = 0;
+size_t Heap::large_object_size = 0;
+size_t Heap::allocated_before_gc = 0;
+const size_t Heap::kEventHistory;
+GCEvent Heap::events[kEventHistory];
+GCEvent Heap::current_event;
+GCEventListener* Heap::event_listener = nullptr;
+MemoryPressureListener* Heap::pressure_listener = nullptr;
+double Heap::soft_clock = 0;
+double Heap::soft_max_age = 0;
+Heap::CostModel Heap::minor_cost;
+Heap::CostModel Heap::major_cost;
+Heap::CostModel Heap::mixed_cost;
+size_t Heap::old_generation_live = 0;
+constexpr double Heap::kIdleSafetyFactor;
+constexpr double Heap::kIdleEdenOccupancy;
+constexpr double Heap::kIdleOldGenerationOccupancy;
 
 void Heap::GlobalInitialize() {
-    eden_space = MemorySpace::New(MEMORY_SPACE_SIZE);
-    survivor_from_space = MemorySpace::New(MEMORY_SPACE_SIZE);
-    survivor_to_space = MemorySpace::New(MEMORY_SPACE_SIZE);
-    tenured_space = MemorySpace::New(MEMORY_SPACE_SIZE);
+    eden_space = MemorySpace::New(config.eden_size, config.prefault_eden);
+    survivor_from_space = MemorySpace::New(config.survivor_size);
+    survivor_to_space = MemorySpace::New(config.survivor_size);
+    tenured_space = MemorySpace::New(config.tenured_size);
 #if NORLIT_DEBUG_MODE
     eden_space->FillUnallocated(0xCC);
     survivor_from_space->FillUnallocated(0xCC);
     survivor_to_space->FillUnallocated(0xCC);
     tenured_space->FillUnallocated(0xCC);
 #endif
+    last_gc_end = Now();
+    last_release = last_gc_end;
+    soft_clock = last_gc_end;
+    statistics.tenuring_threshold = config.tenuring_threshold;
+    statistics.old_generation_limit = config.min_old_generation_size;
     initialized = true;
 }
 
@@ -250,6 +641,18 @@ void Heap::GlobalDestroy() {
     survivor_from_space->Destroy();
     survivor_to_space->Destroy();
     tenured_space->Destroy();
+    if (region_pool) {
+        region_pool->Destroy();
+        region_pool = nullptr;
+    }
+    free(external_set);
+    external_set = nullptr;
+    external_count = 0;
+    external_capacity = 0;
+    free(unreferenced_set);
+    unreferenced_set = nullptr;
+    unreferenced_count = 0;
+    unreferenced_capacity = 0;
 
     // Destroy Large Object Space
     LargeObjectSpaceIterator iter;
@@ -259,19 +662,166 @@ void Heap::GlobalDestroy() {
     }
 }
 
+void Heap::Configure(const HeapConfig& newConfig) {
+    if (newConfig.eden_size > newConfig.max_eden_size ||
+            newConfig.survivor_size > newConfig.max_survivor_size ||
+            newConfig.large_object_threshold * 2 > newConfig.eden_size ||
+            newConfig.large_object_threshold * 2 > newConfig.survivor_size ||
+            newConfig.large_object_threshold * 2 > newConfig.tenured_size) {
+        throw std::invalid_argument{ "Invalid heap configuration" };
+    }
+    if (initialized) {
+        // Spaces are created when the first object (the stack space root) is initialized,
+        // so we can only rebuild them as long as nothing is allocated yet
+        if (eden_space->Size() || survivor_from_space->Size() || tenured_space->Size() ||
+                large_object_space.next != &large_object_space || immortal_space || frozen_space ||
+                region_space) {
+            throw std::runtime_error{ "Heap configured after objects are allocated" };
+        }
+        GlobalDestroy();
+        config = newConfig;
+        GlobalInitialize();
+    } else {
+        config = newConfig;
+    }
+}
+
+const HeapConfig& Heap::Config() {
+    return config;
+}
+
+const HeapStatistics& Heap::Statistics() {
+    return statistics;
+}
+
+size_t Heap::RecentEvents(GCEvent* buffer, size_t count) {
+    uint64_t total = statistics.minor_count + statistics.major_count + statistics.mixed_count;
+    count = static_cast<size_t>(std::min<uint64_t>(std::min<uint64_t>(count, total), kEventHistory));
+    for (size_t i = 0; i < count; i++) {
+        uint64_t id = total - count + i + 1;
+        buffer[i] = events[(id - 1) % kEventHistory];
+    }
+    return count;
+}
+
+void Heap::SetEventListener(GCEventListener* listener) {
+    event_listener = listener;
+}
+
+void Heap::SetMemoryPressureListener(MemoryPressureListener* listener) {
+    pressure_listener = listener;
+}
+
+SpaceUsage Heap::Usage() {
+    return {
+        eden_space->Size(),
+        survivor_from_space->Size(),
+        // Collection set is still part of tenured space until it is evacuated
+        tenured_space->Size() + (collection_set ? collection_set->Size() : 0),
+        large_object_size
+    };
+}
+
+void Heap::BeginEvent(GCType type, GCReason reason) {
+    GCEvent& event = current_event;
+    event.id = statistics.minor_count + statistics.major_count + statistics.mixed_count + 1;
+    event.type = type;
+    event.reason = reason;
+    event.start = Now();
+    std::fill_n(event.phase_time, static_cast<size_t>(GCPhase::COUNT), 0);
+    event.allocated = statistics.allocated - allocated_before_gc;
+    allocated_before_gc = statistics.allocated;
+    event.copied = 0;
+    event.promoted = 0;
+    event.before = Usage();
+    collecting = true;
+
+    // The more free heap there is, the longer soft references are kept. Eden is
+    // left out, as it is always full when GC starts
+    size_t used = event.before.tenured + event.before.large_object;
+    size_t limit = statistics.old_generation_limit;
+    if (config.soft_heap_limit) {
+        used += event.before.survivor;
+        limit = config.soft_heap_limit;
+    }
+    double free = limit > used ? static_cast<double>(limit - used) : 0;
+    soft_clock = event.start;
+    soft_max_age = free / (1024 * 1024) * config.soft_reference_seconds_per_mb;
+}
+
+void Heap::EndEvent() {
+    GCEvent& event = current_event;
+    collecting = false;
+    event.duration = Now() - event.start;
+    event.after = Usage();
+    size_t before = event.before.Total();
+    size_t after = event.after.Total();
+    event.freed = before > after ? before - after : 0;
+
+    if (event.type == GCType::MINOR) {
+        statistics.minor_count++;
+        statistics.minor_time += event.duration;
+    } else if (event.type == GCType::MIXED) {
+        statistics.mixed_count++;
+        statistics.mixed_time += event.duration;
+    } else {
+        statistics.major_count++;
+        statistics.major_time += event.duration;
+    }
+    statistics.max_pause = std::max(statistics.max_pause, event.duration);
+    statistics.copied += event.copied;
+    statistics.promoted += event.promoted;
+    statistics.freed += event.freed;
+
+    events[(event.id - 1) % kEventHistory] = event;
+    if (event_listener) {
+        (*event_listener)(event);
+    }
+    if (pressure_listener && config.soft_heap_limit && after > config.soft_heap_limit) {
+        (*pressure_listener)(after, config.soft_heap_limit);
+    }
+}
+
+double Heap::Now() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Heap::RecordAllocation(void* object, size_t size) {
+    statistics.allocated += size;
+    AllocationProfiler::Allocated(object, size);
+}
+
 void* Heap::Allocate(size_t size) {
     if (allocating_object) {
         assert(0);
     }
 
+    // Take the requests from New() and NewTenured(), so they will not leak to
+    // next allocation if this one throws. They are restored for Initialize() on success
+    uint8_t site = allocating_site;
+    bool tenured = allocating_tenured;
+    bool immortal = allocating_immortal;
+    bool pinned = allocating_pinned;
+    size_t alignment = allocating_alignment;
+    size_t alignmentOffset = allocating_alignment_offset;
+    allocating_site = 0;
+    allocating_tenured = false;
+    allocating_immortal = false;
+    allocating_pinned = false;
+    allocating_alignment = 0;
+    allocating_alignment_offset = 0;
+
 #if NORLIT_DEBUG_MODE == 3
     if (!no_gc_counter) {
-        MinorGC();
+        MinorGC(GCReason::DEBUG);
     }
 #endif
     if (size > 0xFFFFFFFF) {
         throw std::bad_alloc{};
     }
+    if (alignment > Platform::PageSize()) {
+        throw std::invalid_argument{ "Alignment must not exceed the page size" };
+    }
 
     // Align to 8 bytes
     size = (size + 7) &~7;
@@ -279,37 +829,83 @@ void* Heap::Allocate(size_t size) {
     // Set allocating_size so Heap::Initialize can receive info
     allocating_size = static_cast<uint32_t>(size);
 
-    if (size > LARGE_OBJECT_THRESHOLD) {
+    if (immortal) {
+        // Immortal objects are never collected, so there is no reason to GC
+        void* ret = AllocateImmortal(size);
+        RecordAllocation(ret, size);
+        debug("A new object is allocated on %p [Immortal]\n", ret);
+        allocating_object = ret;
+        allocating_site = site;
+        allocating_immortal = true;
+        return ret;
+    }
+
+    if (size > config.large_object_threshold || pinned) {
         // We cannot start GC if no_gc_counter is non-zero
-        if (!no_gc_counter && full_gc_suggested) {
-            MajorGC();
-            full_gc_suggested = false;
-        } else {
-            full_gc_suggested = true;
+        if (!no_gc_counter && OldGenerationFull(size)) {
+            MajorGC(GCReason::LARGE_OBJECT);
         }
 
-        LargeObjectNode* node = static_cast<LargeObjectNode*>(Platform::Allocate(sizeof(LargeObjectNode) + size));
+        // Mappings are page aligned, so aligned objects are placed less than a page
+        // into theirs. The start of the mapping is found by rounding down the node
+        size_t padding = alignment ? (0 - sizeof(LargeObjectNode) - alignmentOffset) & (alignment - 1) : 0;
+        char* memory = static_cast<char*>(Platform::Allocate(padding + sizeof(LargeObjectNode) + size));
+        LargeObjectNode* node = reinterpret_cast<LargeObjectNode*>(memory + padding);
+        Object* object = reinterpret_cast<Object*>(node + 1);
+        try {
+            large_object_index.insert(std::upper_bound(large_object_index.begin(), large_object_index.end(), object), object);
+        } catch (...) {
+            Platform::Free(memory, padding + sizeof(LargeObjectNode) + size);
+            throw;
+        }
         node->prev = large_object_space.prev;
         node->next = &large_object_space;
         large_object_space.prev->next = node;
         large_object_space.prev = node;
+        large_object_size += size;
 
         void* ret = static_cast<void*>(node + 1);
+        RecordAllocation(ret, size);
 
         allocating_object = ret;
+        allocating_site = site;
+        allocating_pinned = pinned;
         debug("A new large object is allocated on %p\n", ret);
         return ret;
     }
 
+    if (tenured) {
+        if (!no_gc_counter && OldGenerationFull(size)) {
+            CollectOldGeneration(GCReason::OLD_GENERATION_FULL);
+        }
+        void* ret = tenured_space->Allocate(size, true);
+        RecordAllocation(ret, size);
+        debug("A new object is allocated on %p [Tenured]\n", ret);
+        allocating_object = ret;
+        allocating_site = site;
+        allocating_tenured = true;
+        return ret;
+    }
+
+    if (region_space) {
+        // Region objects are freed or tenured when the region ends, so they do not
+        // take part in pretenuring and their allocation site is dropped
+        void* ret = AllocateInRegion(size);
+        RecordAllocation(ret, size);
+        debug("A new object is allocated on %p [Region]\n", ret);
+        allocating_object = ret;
+        allocating_region = true;
+        return ret;
+    }
+
     void* ret = eden_space->Allocate(size);
     if (!ret) {
         debug("Reason: Eden space out of memory\n");
         if (!no_gc_counter) {
-            if (full_gc_suggested) {
-                MajorGC();
-                full_gc_suggested = false;
+            if (OldGenerationFull(0)) {
+                CollectOldGeneration(GCReason::OLD_GENERATION_FULL);
             } else {
-                MinorGC();
+                MinorGC(GCReason::EDEN_FULL);
             }
             ret = eden_space->Allocate(size);
             // This should never happen. Eden space is already cleared
@@ -321,8 +917,10 @@ void* Heap::Allocate(size_t size) {
             debug("GC cannot trigger. Allocate on Survivor Space\n");
         }
     }
+    RecordAllocation(ret, size);
     debug("A new object is allocated on %p\n", ret);
     allocating_object = ret;
+    allocating_site = site;
     return ret;
 }
 
@@ -345,14 +943,32 @@ void Heap::Initialize(Object* object) {
             stack_space.stack_.prev_ = object;
 
             object->space_ = Space::STACK_SPACE;
+            object->referrer_ = false;
         }
         return;
     }
 
-    if (allocating_size > LARGE_OBJECT_THRESHOLD) {
+    if (allocating_immortal) {
+        // Immortal objects are never moved. References stored by the constructor go
+        // through the slow write barrier, which remembers the object
+        object->dest_ = object;
+        object->space_ = Space::IMMORTAL_SPACE;
+    } else if (allocating_size > config.large_object_threshold || allocating_pinned) {
         // Large object will never be moved
         object->dest_ = object;
         object->space_ = Space::LARGE_OBJECT_SPACE;
+    } else if (allocating_tenured) {
+        // The object is constructed as if it were young, so the constructor can store
+        // references without reference counting. FinishTenuredAllocation will fix it up
+        object->space_ = Space::SURVIVOR_SPACE;
+        // Tenured objects are only moved in major GC, and minor GC relies on dest_
+        // pointing to the object itself, as large objects do
+        object->dest_ = object;
+    } else if (allocating_region) {
+        // Region chunks are zeroed before reuse, so the slow write barrier that
+        // constructors run does not see stale references
+        object->dest_ = object;
+        object->space_ = Space::REGION_SPACE;
     } else if (
         !no_gc_counter || (
             // If no_gc_counter is true we need to have an extra check to see if
@@ -369,59 +985,458 @@ void Heap::Initialize(Object* object) {
     object->size_ = allocating_size;
     object->status_ = Status::NOT_MARKED;
     object->lifetime_ = 0;
+    object->site_ = allocating_site;
+    object->pins_ = 0;
+    object->referrer_ = false;
+    object->external_ = false;
+    object->estimated_ = false;
     allocating_size = 0;
     allocating_object = nullptr;
+    allocating_site = 0;
+    allocating_tenured = false;
+    allocating_immortal = false;
+    allocating_pinned = false;
+    allocating_region = false;
 }
 
-void Heap::UntrackStackObject(Object* object) {
-    // If we already destory the heap, we are not going to track stack any more
-    if (!initialized) {
-        return;
-    }
-    if (object == &stack_space) {
-        // If it's the global destructor, clean up everything
-        GlobalDestroy();
-        initialized = false;
+void Heap::FinishTenuredAllocation(Object* object) {
+    // Large objects are already in a space that uses reference counting
+    if (object->space_ == Space::LARGE_OBJECT_SPACE) {
         return;
     }
-
-    // When we release a stack object, we decrease refcount,
-    // otherwise the referenced object can only be reclaimed in MajorGC
-    object->IterateField(DecRefIterator{});
-    // Detach from linked list
-    object->stack_.prev_->stack_.next_ = object->stack_.next_;
-    object->stack_.next_->stack_.prev_ = object->stack_.prev_;
+    // Same as what PromoteToTenuredSpace does
+    object->space_ = Space::TENURED_SPACE;
+    object->IterateField(IncRefIterator{});
 }
 
-void Heap::Minor_ScanRoot(MemorySpace* space) {
-    // In minor GC, the "root" are actually objects referenced by
-    // real roots and tenured object
-    for (Object* object : Iterable<MemorySpaceIterator> {space}) {
-        if (object->refcount_) {
-            object->status_ = Status::MARKING;
-        }
+void* Heap::AllocateImmortal(size_t size) {
+    size_t chunkSize = std::max(config.tenured_size, offsetof(MemorySpace, data) + size);
+    void* ret = immortal_space ? immortal_space->Allocate(size) : nullptr;
+    if (!ret) {
+        // New chunks are linked at head, so an oversized chunk does not decide the
+        // size of those after it
+        MemorySpace* chunk = MemorySpace::New(chunkSize);
+        chunk->next = immortal_space;
+        immortal_space = chunk;
+        ret = chunk->Allocate(size);
+        assert(ret);
     }
+    return ret;
 }
 
-void Heap::Major_ScanHeapRoot() {
-    // In major GC, the "root" are objects referenced by real roots
-    for (Object* object : Iterable<StackSpaceIterator> {}) {
-        object->IterateField(MarkingIterator{});
+void* Heap::AllocateInRegion(size_t size) {
+    void* ret = region_space->Allocate(size);
+    if (!ret) {
+        // New chunks are linked at head, as in Immortal Space
+        MemorySpace* chunk = region_pool;
+        if (chunk) {
+            region_pool = chunk->next;
+        } else {
+            chunk = MemorySpace::New(config.tenured_size);
+        }
+        chunk->next = region_space;
+        region_space = chunk;
+        ret = chunk->Allocate(size);
+        assert(ret);
     }
+    return ret;
 }
 
-template<typename I>
-bool Heap::Mark(Iterable<I> iter) {
-    // Classic mark algorithm
-    bool modified = false;
-    for (Object* object : iter) {
-        if (object->status_ == Status::MARKING) {
-            modified = true;
-            object->IterateField(MarkingIterator{});
+void Heap::EnterRegion() {
+    if (region_depth++) {
+        return;
+    }
+    MemorySpace* chunk = region_pool;
+    if (chunk) {
+        region_pool = chunk->next;
+        chunk->next = nullptr;
+    } else {
+        chunk = MemorySpace::New(config.tenured_size);
+    }
+    region_space = chunk;
+    Object::region_entered = true;
+}
+
+void Heap::ExitRegion() {
+    if (--region_depth) {
+        return;
+    }
+    MemorySpace* space = region_space;
+
+    // Counts left after discounting references between region objects and weak
+    // references from outside come from handles, stack objects and old objects
+    for (Object* object : Iterable<MemorySpaceIterator> { space }) {
+        object->IterateField(RegionTrialIterator{ false });
+    }
+    for (Object* object : region_referrers) {
+        object->IterateField(RegionWeakIterator{ object, IsCounted(object), false });
+    }
+    std::vector<Object*> escaped;
+    for (Object* object : Iterable<MemorySpaceIterator> { space }) {
+        if (object->refcount_) {
             object->status_ = Status::MARKED;
+            escaped.push_back(object);
+        }
+    }
+    // References from young objects are not counted, so they are found by scanning
+    for (Object* object : region_referrers) {
+        if (!IsCounted(object)) {
+            object->IterateField(RegionEscapeIterator{ escaped });
+        }
+    }
+    for (size_t i = 0; i < escaped.size(); i++) {
+        escaped[i]->IterateField(RegionEscapeIterator{ escaped });
+    }
+    AllocationProfiler::RegionExited();
+
+    // Restore counts of surviving objects before fields of freed objects become
+    // inaccessible
+    for (Object* object : Iterable<MemorySpaceIterator> { space }) {
+        if (object->status_ == Status::MARKED) {
+            object->IterateField(RegionTrialIterator{ true });
+        } else {
+            object->IterateField(RegionDeadDecRefIterator{});
+        }
+    }
+    Finalize<MemorySpaceIterator>(space);
+    for (Object* object : region_referrers) {
+        object->IterateField(RegionWeakIterator{ object, IsCounted(object), true });
+        object->referrer_ = false;
+    }
+    region_referrers.clear();
+    for (Object* object : Iterable<MemorySpaceIterator> { space }) {
+        if (object->status_ == Status::MARKED) {
+            object->IterateField(RegionWeakIterator{ object, false, true });
+        }
+    }
+
+    // Chunks with surviving objects become tenured chunks. Freed objects in them
+    // are replaced by fillers until next major GC compacts them
+    size_t survived = 0;
+    size_t freed = 0;
+    MemorySpace* tail = tenured_space;
+    while (tail->next) {
+        tail = tail->next;
+    }
+    for (MemorySpace* chunk = space, *next; chunk; chunk = next) {
+        next = chunk->next;
+        chunk->next = nullptr;
+        bool live = false;
+        size_t garbage = 0;
+        for (char* ptr = chunk->Begin(); ptr < chunk->End(); ptr += reinterpret_cast<Object*>(ptr)->size_) {
+            Object* object = reinterpret_cast<Object*>(ptr);
+            object->space_ = Space::TENURED_SPACE;
+            if (object->status_ == Status::MARKED) {
+                object->status_ = Status::NOT_MARKED;
+                survived += object->size_;
+                live = true;
+            } else {
+                garbage += object->size_;
+                pinned_count -= object->pins_;
+                MakeFiller(object);
+            }
+        }
+        freed += garbage;
+        if (live) {
+            // Fillers are garbage mixed GC can reclaim
+            chunk->garbage = garbage;
+            chunk->SaveOriginal();
+            tail->next = chunk;
+            tail = chunk;
+        } else {
+            memset(chunk->Begin(), 0, chunk->End() - chunk->Begin());
+            chunk->Clear();
+            chunk->next = region_pool;
+            region_pool = chunk;
+        }
+    }
+    region_space = nullptr;
+    Object::region_entered = false;
+    statistics.promoted += survived;
+    statistics.freed += freed;
+    debug("Region ends, %zu bytes survived and %zu bytes freed\n", survived, freed);
+}
+
+Object* Heap::ResizeLargeObject(Object* object, size_t size) {
+    if (object->space_ != Space::LARGE_OBJECT_SPACE) {
+        return nullptr;
+    }
+    size = (size + 7) &~7;
+    if (size > 0xFFFFFFFF) {
+        throw std::bad_alloc{};
+    }
+
+    LargeObjectNode* node = reinterpret_cast<LargeObjectNode*>(object) - 1;
+    // Aligned pinned objects do not start their mapping, and must not move anyway
+    if (reinterpret_cast<uintptr_t>(node) & (Platform::PageSize() - 1)) {
+        return nullptr;
+    }
+    size_t oldSize = object->size_;
+    // Growth counts towards the old generation as allocating would. Callers hold no
+    // handle to object, so rather than collecting here, fall back to allocating a
+    // copy, which collects first
+    if (size > oldSize && !no_gc_counter && OldGenerationFull(size - oldSize)) {
+        return nullptr;
+    }
+    void* moved = Platform::Reallocate(node, sizeof(LargeObjectNode) + oldSize, sizeof(LargeObjectNode) + size);
+    if (!moved) {
+        return nullptr;
+    }
+    node = static_cast<LargeObjectNode*>(moved);
+    node->prev->next = node;
+    node->next->prev = node;
+
+    Object* ret = reinterpret_cast<Object*>(node + 1);
+    ret->dest_ = ret;
+    ret->size_ = static_cast<uint32_t>(size);
+    large_object_size = large_object_size + size - oldSize;
+    if (size > oldSize) {
+        statistics.allocated += size - oldSize;
+    }
+    if (ret != object) {
+        // The entry is removed first, so the insertion does not need to grow the index
+        large_object_index.erase(std::lower_bound(large_object_index.begin(), large_object_index.end(), object));
+        large_object_index.insert(std::upper_bound(large_object_index.begin(), large_object_index.end(), ret), ret);
+        if (ret->referrer_) {
+            *std::find(region_referrers.begin(), region_referrers.end(), object) = ret;
+        }
+        AllocationProfiler::Moved(object, ret);
+        debug("Large object %p is remapped to %p\n", object, ret);
+    }
+    return ret;
+}
+
+void Heap::Pin(const Handle<Object>& handle) {
+    Object* object = handle;
+    if (!object || object->IsTagged()) {
+        throw std::invalid_argument{ "Only heap objects can be pinned" };
+    }
+    switch (object->space_) {
+        case Space::EDEN_SPACE:
+        case Space::SURVIVOR_SPACE:
+            // Young objects are moved by every minor GC, and moving one out of the
+            // young generation takes a GC to update references to it
+            throw std::invalid_argument{ "Young objects cannot be pinned, create them with NewPinned or NewTenured" };
+        case Space::TENURED_SPACE:
+        // Region objects may become tenured
+        case Space::REGION_SPACE:
+            break;
+        default:
+            return;
+    }
+    if (object->pins_ == UINT8_MAX) {
+        throw std::runtime_error{ "Object is pinned too many times" };
+    }
+    object->pins_++;
+    pinned_count++;
+}
+
+void Heap::Unpin(Object* object) {
+    if (object->space_ != Space::TENURED_SPACE && object->space_ != Space::REGION_SPACE) {
+        return;
+    }
+    assert(object->pins_);
+    object->pins_--;
+    pinned_count--;
+}
+
+void Heap::MakeFiller(Object* object) {
+    // The destructor has already run, so only the vtable and header are replaced
+    uint32_t size = object->size_;
+    ::new (static_cast<void*>(object)) Filler();
+    object->dest_ = nullptr;
+    object->refcount_ = 0;
+    object->size_ = size;
+    object->space_ = Space::TENURED_SPACE;
+    object->status_ = Status::NOT_MARKED;
+    object->lifetime_ = 0;
+    object->site_ = 0;
+    object->pins_ = 0;
+    object->referrer_ = false;
+    object->external_ = false;
+    // Callers count the filler in the garbage estimate of its chunk
+    object->estimated_ = true;
+}
+
+bool Heap::IsFiller(Object* object) {
+    return typeid(*object) == typeid(Filler);
+}
+
+bool Heap::HasPinned(MemorySpace* chunk, char* end) {
+    for (char* ptr = chunk->Begin(); ptr < end; ptr += reinterpret_cast<Object*>(ptr)->size_) {
+        if (reinterpret_cast<Object*>(ptr)->pins_) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Heap::FreezeImmortal() {
+    // Only objects that reference nothing mortal can be left alone by GC
+    PruneRememberedSet();
+    if (remembered_count) {
+        throw std::runtime_error{ "Immortal objects still reference mortal objects" };
+    }
+    // Link chunks into frozen_space before protecting them, as that writes their headers
+    while (immortal_space) {
+        MemorySpace* chunk = immortal_space;
+        immortal_space = chunk->next;
+        chunk->next = frozen_space;
+        frozen_space = chunk;
+    }
+    for (MemorySpace* chunk = frozen_space; chunk; chunk = chunk->next) {
+        Platform::Protect(chunk, chunk->capacity);
+    }
+}
+
+uint8_t Heap::RegisterAllocationSite(const char* name) {
+    if (allocation_site_count == kMaxAllocationSite) {
+        // Too many types, the rest are untracked
+        return 0;
+    }
+    AllocationSite& site = allocation_sites[allocation_site_count];
+    site.name = name;
+    site.promoted = 0;
+    site.died = 0;
+    site.pretenured = false;
+    return static_cast<uint8_t>(allocation_site_count++);
+}
+
+void Heap::RecordSiteSurvival(Object* object, bool promoted) {
+    if (!object->site_) {
+        return;
+    }
+    AllocationSite& site = allocation_sites[object->site_];
+    if (promoted) {
+        site.promoted++;
+    } else {
+        site.died++;
+    }
+    uint32_t samples = site.promoted + site.died;
+    if (samples >= kPretenureSampleSize) {
+        // While a site is pretenured, its samples come from major GC instead
+        bool pretenured = config.pretenuring && site.promoted >= samples * config.pretenure_ratio;
+        if (pretenured && !site.pretenured) {
+            debug("Objects of %s will be pretenured\n", site.name);
+        } else if (!pretenured && site.pretenured) {
+            debug("Objects of %s will no longer be pretenured\n", site.name);
+        }
+        site.pretenured = pretenured;
+        site.promoted = 0;
+        site.died = 0;
+    }
+}
+
+void Heap::UntrackStackObject(Object* object) {
+    // If we already destory the heap, we are not going to track stack any more
+    if (!initialized) {
+        return;
+    }
+    if (object == &stack_space) {
+        // If it's the global destructor, clean up everything
+        GlobalDestroy();
+        initialized = false;
+        return;
+    }
+
+    // When we release a stack object, we decrease refcount,
+    // otherwise the referenced object can only be reclaimed in MajorGC
+    object->IterateField(DecRefIterator{});
+    if (object->referrer_) {
+        region_referrers.erase(std::find(region_referrers.begin(), region_referrers.end(), object));
+    }
+    // Detach from linked list
+    object->stack_.prev_->stack_.next_ = object->stack_.next_;
+    object->stack_.next_->stack_.prev_ = object->stack_.prev_;
+}
+
+void Heap::Minor_ScanRoot() {
+    // In minor GC, the "root" are actually objects referenced by
+    // real roots and tenured object. All of them are in the externally referenced set.
+    // Each root is marked through before the next one is pushed, so the worklist is
+    // bounded by the depth of the graph rather than by the number of roots
+    for (size_t i = 0; i < external_count; i++) {
+        Object* object = external_set[i];
+        if (object->refcount_ && object->status_ == Status::NOT_MARKED &&
+                (object->space_ == Space::EDEN_SPACE || object->space_ == Space::SURVIVOR_SPACE)) {
+            MarkObject(object);
+            Mark();
+        }
+    }
+}
+
+void Heap::Major_ScanHeapRoot() {
+    // In major GC, the "root" are objects referenced by real roots
+    for (Object* object : Iterable<StackSpaceIterator> {}) {
+        object->IterateField(MarkingIterator{});
+    }
+    // and by immortal objects, which are never collected
+    for (Object* object : Iterable<RememberedSetIterator> {}) {
+        object->IterateField(MarkingIterator{});
+    }
+    // and by objects of the active region
+    if (region_space) {
+        for (Object* object : Iterable<MemorySpaceIterator> { region_space }) {
+            object->IterateField(MarkingIterator{});
+        }
+    }
+}
+
+bool Heap::Traced(Object* object) {
+    // Objects outside of the spaces being collected are only flagged. Their
+    // references to collected spaces are accounted for by reference counts
+    switch (object->space_) {
+        case Space::EDEN_SPACE:
+        case Space::SURVIVOR_SPACE:
+            return true;
+        case Space::TENURED_SPACE:
+            return current_event.type == GCType::MAJOR ||
+                   (current_event.type == GCType::MIXED && InCollectionSet(object));
+        case Space::LARGE_OBJECT_SPACE:
+            return current_event.type == GCType::MAJOR;
+        default:
+            return false;
+    }
+}
+
+bool Heap::IsDead(Object* object) {
+    // Only meaningful during GC, between marking and copying
+    return collecting && object && !object->IsTagged() && Traced(object) && object->status_ != Status::MARKED;
+}
+
+void Heap::MarkObject(Object* object) {
+    object->status_ = Status::MARKING;
+    if (Traced(object)) {
+        mark_worklist.push_back({ object, 0 });
+    }
+}
+
+void Heap::Mark() {
+    while (!mark_worklist.empty()) {
+        MarkEntry entry = mark_worklist.back();
+        if (!entry.object) {
+            mark_worklist.pop_back();
+            continue;
+        }
+        // The entry stays below references pushed by this slice, so they are scanned
+        // before the rest of the object. This keeps the worklist short for large arrays
+        size_t index = mark_worklist.size() - 1;
+        if (!entry.next && (entry.object->space_ == Space::EDEN_SPACE || entry.object->space_ == Space::SURVIVOR_SPACE)) {
+            copy_order.push_back(entry.object);
+        }
+        mark_hot_entry = 0;
+        size_t next = entry.object->IterateFieldSlice(MarkingIterator{}, entry.next, kMarkSliceSize);
+        if (mark_hot_entry) {
+            // Scan the hot field's object next, so it is copied right after this one
+            std::swap(mark_worklist[mark_hot_entry], mark_worklist.back());
+        }
+        if (next) {
+            mark_worklist[index].next = next;
+        } else {
+            mark_worklist[index].object = nullptr;
+            entry.object->status_ = Status::MARKED;
         }
     }
-    return modified;
 }
 
 template<typename I>
@@ -429,7 +1444,10 @@ void Heap::Finalize(Iterable<I> iter) {
     // Calling destructors
     for (Object* object : iter) {
         if (object->status_ != Status::MARKED) {
-            object->~Object();
+            // Fillers stand for objects that are already destructed
+            if (!IsFiller(object)) {
+                object->~Object();
+            }
             // We set object->dest_ here because LargeObjectSpace
             // do not have a pass that helps set dest_ field.
             object->dest_ = nullptr;
@@ -493,78 +1511,648 @@ void Heap::UpdateStackReference() {
     }
 }
 
-void Heap::EdenSpace_CalculateTarget() {
-    // Calculate target address for Eden Space.
-    // This is simple because the only target is Survivor Space
-    for (Object* object : Iterable<MemorySpaceIterator> { eden_space }) {
-        if (object->status_ == Status::MARKED) {
-            // All Eden Space objects that survives a minor GC will be moved to survivor space
-            object->dest_ = static_cast<Object*>(
-                                survivor_to_space->Allocate(object->size_, true)
-                            );
-            debug("Object %p [Eden] is moved to %p [Survivor]\n", object, object->dest_);
-            object->space_ = Space::SURVIVOR_SPACE;
-            object->lifetime_++;
+void Heap::UpdateImmortalReference() {
+    for (Object* object : Iterable<RememberedSetIterator> {}) {
+        object->IterateField(UpdateIterator{});
+    }
+    PruneRememberedSet();
+}
+
+void Heap::PruneRememberedSet() {
+    // Forget immortal objects that no longer reference mortal objects
+    size_t kept = 0;
+    for (size_t i = 0; i < remembered_count; i++) {
+        Object* object = remembered_set[i];
+        bool mortal = false;
+        object->IterateField(MortalReferenceIterator{ mortal });
+        if (mortal) {
+            remembered_set[kept++] = object;
         } else {
-            debug("Reclaim %p\n", object);
-            // dest_ is set in Finalize
+            object->status_ = Status::NOT_MARKED;
+        }
+    }
+    remembered_count = kept;
+}
+
+void Heap::Remember(Object* object) {
+    if (object->status_ == Status::MARKED) {
+        return;
+    }
+    if (remembered_count == remembered_capacity) {
+        size_t capacity = remembered_capacity ? remembered_capacity * 2 : 64;
+        Object** set = static_cast<Object**>(realloc(remembered_set, capacity * sizeof(Object*)));
+        if (!set) {
+            throw std::bad_alloc{};
         }
+        remembered_set = set;
+        remembered_capacity = capacity;
     }
+    object->status_ = Status::MARKED;
+    remembered_set[remembered_count++] = object;
 }
 
 void Heap::PromoteToTenuredSpace(Object *object) {
     // Promote an object from survivor space to tenured space
-    void* target = tenured_space->Allocate(object->size_);
-    if (!target) {
-        full_gc_suggested = true;
-        target = tenured_space->Allocate(object->size_, true);
-    }
+    void* target = tenured_space->Allocate(object->size_, true);
     object->dest_ = static_cast<Object*>(target);
     debug("Object %p [Survivor] is promoted to %p [Tenure]\n", object, object->dest_);
     object->space_ = Space::TENURED_SPACE;
+    current_event.promoted += object->size_;
+    RecordSiteSurvival(object, true);
+    // Only pretenured objects keep their site in tenured space, until major GC samples them
+    object->site_ = 0;
     // Since in tenured space, we use reference counting to avoid the marking phase, we increase ref here
     object->IterateField(IncRefIterator{});
 }
 
-void Heap::SurvivorSpace_CalculateTarget() {
-    MemorySpace* space = survivor_from_space;
-    for (Object* object : Iterable<MemorySpaceIterator> { space }) {
-        if (object->status_ == Status::MARKED) {
-            // Promote an object that survives many times of GC
-            if (object->lifetime_ > TENURED_SPACE_THRESHOLD) {
-                PromoteToTenuredSpace(object);
-            } else {
-                // Objects that survives less than THRESHOLD times GC will remain in survivor space
-                object->dest_ = static_cast<Object*>(
-                                    survivor_to_space->Allocate(object->size_, true)
-                                );
-                debug("Object %p [Survivor] is moved to %p [Survivor]\n", object, object->dest_);
-                object->lifetime_++;
+void Heap::RecordExternal(Object* object) {
+    if (external_count == external_capacity) {
+        // Drop entries no longer referenced from outside first, so the set is bounded
+        // by the number of externally referenced objects rather than by allocation.
+        // Not during GC, where entries may be dead or half moved
+        if (!collecting) {
+            PruneExternalSet();
+        }
+        if (external_count >= external_capacity / 2) {
+            ReserveExternalSet(external_capacity - external_count + 1);
+        }
+    }
+    object->external_ = true;
+    external_set[external_count++] = object;
+}
+
+void Heap::ReserveExternalSet(size_t count) {
+    // Called by GC after marking with the number of young survivors, so the set is
+    // usually not grown while objects are moved. During GC only survivors are added,
+    // when promoted objects reference them, and each at most once as the set is not
+    // pruned then
+    if (external_count + count <= external_capacity) {
+        return;
+    }
+    size_t capacity = std::max<size_t>(std::max(external_capacity * 2, external_count + count), 64);
+    Object** set = static_cast<Object**>(realloc(external_set, capacity * sizeof(Object*)));
+    if (!set) {
+        throw std::bad_alloc{};
+    }
+    external_set = set;
+    external_capacity = capacity;
+}
+
+void Heap::PruneExternalSet() {
+    size_t kept = 0;
+    for (size_t i = 0; i < external_count; i++) {
+        Object* object = external_set[i];
+        if (object->refcount_ && (object->space_ == Space::EDEN_SPACE || object->space_ == Space::SURVIVOR_SPACE)) {
+            external_set[kept++] = object;
+        } else {
+            object->external_ = false;
+        }
+    }
+    external_count = kept;
+}
+
+void Heap::RecordUnreferenced(Object* object) {
+    if (collecting) {
+        return;
+    }
+    if (unreferenced_count == unreferenced_capacity) {
+        PruneUnreferencedSet();
+        if (unreferenced_count >= unreferenced_capacity / 2) {
+            size_t capacity = unreferenced_capacity ? unreferenced_capacity * 2 : 64;
+            Object** set = static_cast<Object**>(realloc(unreferenced_set, capacity * sizeof(Object*)));
+            if (set) {
+                unreferenced_set = set;
+                unreferenced_capacity = capacity;
             }
+        }
+        // Counts are dropped by destructors of handles and stack objects, which must
+        // not throw. The object is left out of the estimate instead
+        if (unreferenced_count == unreferenced_capacity) {
+            return;
+        }
+    }
+    object->estimated_ = true;
+    unreferenced_set[unreferenced_count++] = object;
+}
+
+void Heap::PruneUnreferencedSet() {
+    size_t kept = 0;
+    for (size_t i = 0; i < unreferenced_count; i++) {
+        Object* object = unreferenced_set[i];
+        if (!object->refcount_) {
+            unreferenced_set[kept++] = object;
         } else {
-            debug("Reclaim %p\n", object);
-            // dest_ is set in Finalize
+            object->estimated_ = false;
         }
     }
+    unreferenced_count = kept;
 }
 
-void Heap::TenuredSpace_CalculateTarget() {
-    for (Object* object : Iterable < MemorySpaceIterator > { tenured_space, true }) {
+void Heap::UpdateExternalSet() {
+    // Must be done before young objects are copied, as copying resets status_. Entries
+    // are replaced by the address objects are copied to, and survivors that are
+    // promoted or no longer referenced from outside are removed
+    size_t kept = 0;
+    for (size_t i = 0; i < external_count; i++) {
+        Object* object = external_set[i];
+        if (object->status_ == Status::MARKED && object->refcount_ && object->space_ == Space::SURVIVOR_SPACE) {
+            external_set[kept++] = object->dest_;
+        } else {
+            object->external_ = false;
+        }
+    }
+    external_count = kept;
+}
+
+void Heap::RecordRegionReferrer(Object* object) {
+    region_referrers.push_back(object);
+    object->referrer_ = true;
+}
+
+void Heap::UpdateRegionReferrers() {
+    // Same as UpdateExternalSet, entries are replaced by the address objects are
+    // moved to, and dead objects are removed
+    size_t kept = 0;
+    for (Object* object : region_referrers) {
+        switch (object->space_) {
+            case Space::STACK_SPACE:
+            case Space::IMMORTAL_SPACE:
+                region_referrers[kept++] = object;
+                break;
+            case Space::EDEN_SPACE:
+            case Space::SURVIVOR_SPACE:
+                if (object->status_ == Status::MARKED) {
+                    region_referrers[kept++] = object->dest_;
+                }
+                break;
+            default:
+                // Dead objects have null dest_ since Finalize
+                if (object->dest_) {
+                    region_referrers[kept++] = object->dest_;
+                }
+                break;
+        }
+    }
+    region_referrers.resize(kept);
+}
+
+bool Heap::IsCounted(Object* object) {
+    // Same condition as the write barrier
+    return object->space_ != Space::EDEN_SPACE && object->space_ != Space::SURVIVOR_SPACE;
+}
+
+void Heap::YoungSpace_CalculateTarget() {
+    // Calculate target address for Eden Space and Survivor Space. Survivors are
+    // placed in the order marking scanned them, which is depth-first, so objects
+    // end up next to the object that first referenced them
+    for (Object* object : copy_order) {
+        if (object->space_ == Space::EDEN_SPACE) {
+            // All Eden Space objects that survives a minor GC will be moved to survivor space
+            object->dest_ = static_cast<Object*>(
+                                survivor_to_space->Allocate(object->size_, true)
+                            );
+            debug("Object %p [Eden] is moved to %p [Survivor]\n", object, object->dest_);
+            object->space_ = Space::SURVIVOR_SPACE;
+            object->lifetime_++;
+            RecordSurvivor(object);
+        } else if (object->lifetime_ > statistics.tenuring_threshold) {
+            // Promote an object that survives many times of GC
+            PromoteToTenuredSpace(object);
+        } else {
+            // Objects that survives less than threshold times GC will remain in survivor space
+            object->dest_ = static_cast<Object*>(
+                                survivor_to_space->Allocate(object->size_, true)
+                            );
+            debug("Object %p [Survivor] is moved to %p [Survivor]\n", object, object->dest_);
+            object->lifetime_++;
+            RecordSurvivor(object);
+        }
+    }
+    copy_order.clear();
+
+    for (MemorySpace* space : { eden_space, survivor_from_space }) {
+        for (Object* object : Iterable<MemorySpaceIterator> { space }) {
+            if (object->status_ != Status::MARKED) {
+                RecordSiteSurvival(object, false);
+                debug("Reclaim %p\n", object);
+                // dest_ is set in Finalize
+            }
+        }
+    }
+}
+
+void Heap::CollectionSet_CalculateTarget() {
+    for (Object* object : Iterable<MemorySpaceIterator> { collection_set }) {
         if (object->status_ == Status::MARKED) {
+            object->estimated_ = false;
+            // Evacuate to chunks outside the collection set
             object->dest_ = static_cast<Object*>(
                                 tenured_space->Allocate(object->size_, true)
                             );
-            debug("Object %p [Tenured] is moved to %p [Tenured]\n", object, object->dest_);
+            debug("Object %p [Tenured] is evacuated to %p [Tenured]\n", object, object->dest_);
+            current_event.copied += object->size_;
         } else {
-            // When tenured objects are collected, decrease ref to
-            // allow referenced young objects to be recycled in minor GC
-            object->IterateField(DecRefIterator{});
+            // Reference counts are already decreased in Mixed_RestoreRefCount
             debug("Reclaim Tenured %p\n", object);
             // dest_ is set in Finalize
         }
     }
 }
 
+void Heap::RecordSurvivor(Object* object) {
+    statistics.age_histogram[object->lifetime_] += object->size_;
+    current_event.copied += object->size_;
+}
+
+void Heap::UpdateTenuringThreshold() {
+    if (!config.adaptive) {
+        statistics.tenuring_threshold = config.tenuring_threshold;
+        return;
+    }
+
+    // Similar to HotSpot: find the youngest age at which survivors exceed desired
+    // occupancy, and promote objects of that age or older in next GC
+    size_t desired = static_cast<size_t>(config.max_survivor_size * config.target_survivor_ratio);
+    size_t total = 0;
+    size_t age = 1;
+    for (; age <= config.tenuring_threshold; age++) {
+        total += statistics.age_histogram[age];
+        if (total > desired) {
+            break;
+        }
+    }
+    statistics.tenuring_threshold = static_cast<uint8_t>(age - 1);
+    debug("Tenuring threshold is set to %d\n", statistics.tenuring_threshold);
+}
+
+void Heap::TenuredSpace_CalculateTarget() {
+    // Garbage estimates start over, as all garbage is freed. Pending objects are
+    // either freed or found alive below
+    unreferenced_count = 0;
+
+    // Chunks holding pinned objects are not compacted. Their top is restored before
+    // anything is allocated, so nothing is moved over their objects
+    std::vector<MemorySpace*> pinnedChunks;
+    if (pinned_count) {
+        for (MemorySpace* chunk = tenured_space; chunk; chunk = chunk->next) {
+            if (HasPinned(chunk, chunk->OriginalEnd())) {
+                chunk->top = chunk->topOriginal;
+                pinnedChunks.push_back(chunk);
+            }
+        }
+    }
+
+    // Chunks are appended when tenured space expands, so they are visited in order
+    for (MemorySpace* chunk = tenured_space; chunk; chunk = chunk->next) {
+        bool pinned = std::find(pinnedChunks.begin(), pinnedChunks.end(), chunk) != pinnedChunks.end();
+        for (char* ptr = chunk->Begin(); ptr < chunk->OriginalEnd(); ptr += reinterpret_cast<Object*>(ptr)->size_) {
+            Object* object = reinterpret_cast<Object*>(ptr);
+            if (pinned) {
+                // Object starts were cleared with the rest of the space
+                chunk->SetStart(object);
+            }
+            // Pretenured objects count as promoted if they live until the first major GC
+            // after their allocation, so sites that stop surviving are reverted
+            if (object->site_) {
+                RecordSiteSurvival(object, object->status_ == Status::MARKED);
+                object->site_ = 0;
+            }
+            if (object->status_ == Status::MARKED) {
+                object->estimated_ = false;
+                object->dest_ = pinned ? object : static_cast<Object*>(
+                                    tenured_space->Allocate(object->size_, true)
+                                );
+                debug("Object %p [Tenured] is moved to %p [Tenured]\n", object, object->dest_);
+            } else {
+                // When tenured objects are collected, decrease ref to
+                // allow referenced young objects to be recycled in minor GC
+                object->IterateField(DecRefIterator{});
+                debug("Reclaim Tenured %p\n", object);
+                // Pins of unreachable objects can never be undone
+                pinned_count -= object->pins_;
+                object->pins_ = 0;
+                // dest_ is set in Finalize. Dead objects in pinned chunks are replaced
+                // by fillers until the chunk is compacted
+                if (pinned) {
+                    chunk->garbage += object->size_;
+                    MakeFiller(object);
+                }
+            }
+        }
+    }
+}
+
+namespace {
+
+void ResizeSpace(MemorySpace*& space, size_t capacity, bool populate = false) {
+    // Only used on empty spaces, so nothing needs to be moved
+    space->Destroy();
+    space = MemorySpace::New(capacity, populate);
+#if NORLIT_DEBUG_MODE
+    space->FillUnallocated(0xCC);
+#endif
+}
+
+size_t ClampSize(size_t size, size_t min, size_t max) {
+    // Round the same way as MemorySpace::New, so the result is comparable to capacity
+    return Platform::RoundSize(std::min(std::max(size, min), max));
+}
+
+}
+
+void Heap::AdjustGenerationSizes(double start, double end, size_t allocated, size_t survived) {
+    double pause = end - start;
+    double interval = end - last_gc_end;
+    last_gc_end = end;
+
+    if (!config.adaptive) {
+        return;
+    }
+
+    // Eden Space. Cost of a minor GC is roughly proportional to survivors, and
+    // survivors are roughly a fixed fraction of eden, so a larger eden means
+    // fewer but longer pauses.
+    size_t edenCapacity = eden_space->capacity;
+    size_t edenTarget = edenCapacity;
+    if (allocated * 2 >= edenCapacity && interval > 0) {
+        // Only GCs triggered by a (nearly) full eden say anything about allocation rate
+        double ratio = pause / interval;
+        if (ratio > config.gc_time_ratio) {
+            edenTarget = edenCapacity * 2;
+        } else if (ratio < config.gc_time_ratio / 4) {
+            edenTarget = edenCapacity - edenCapacity / 4;
+        }
+    }
+    if (config.pause_goal) {
+        edenTarget = std::min(edenTarget, MaxEdenSize());
+    }
+    edenTarget = ClampSize(edenTarget, config.eden_size, config.max_eden_size);
+    // Resizing costs a remap, so ignore small changes caused by noise of the predictions
+    if (edenTarget > edenCapacity + edenCapacity / 8 || edenTarget < edenCapacity - edenCapacity / 8) {
+        debug("Eden space resized to %zu\n", edenTarget);
+        ResizeSpace(eden_space, edenTarget, config.prefault_eden);
+    }
+
+    // Survivor Space. Aim at survivors occupying half of a chunk, so that survival
+    // spikes do not immediately expand the space. Only the empty to-space can
+    // be resized, the from-space will be resized after the next minor GC.
+    size_t survivorCapacity = survivor_to_space->capacity;
+    size_t survivorTarget = ClampSize(survived * 2, config.survivor_size, config.max_survivor_size);
+    if (survivorTarget > survivorCapacity || survivorTarget < survivorCapacity / 2) {
+        debug("Survivor space resized to %zu\n", survivorTarget);
+        ResizeSpace(survivor_to_space, survivorTarget);
+    }
+}
+
+void Heap::UpdateMinorCost(double pause) {
+    // Survivor space is walked as well as eden, so both count as collected
+    double young = static_cast<double>(current_event.before.eden + current_event.before.survivor);
+    double survived = static_cast<double>(current_event.copied + current_event.promoted);
+    double rate = young > 0 ? survived / young : 0;
+    statistics.survival_rate = statistics.minor_count ? statistics.survival_rate * 0.7 + rate * 0.3 : rate;
+    minor_cost.Add(young, survived, pause);
+}
+
+void Heap::UpdateMajorCost(double pause) {
+    // Marking is proportional to live objects and sweeping to the whole heap
+    major_cost.Add(
+        static_cast<double>(current_event.before.Total()),
+        static_cast<double>(Usage().Total()),
+        pause
+    );
+}
+
+void Heap::UpdateMixedCost(double pause, size_t collected) {
+    // The collection set is walked and evacuated like young objects
+    mixed_cost.Add(
+        static_cast<double>(current_event.before.eden + current_event.before.survivor + collected),
+        static_cast<double>(current_event.copied + current_event.promoted),
+        pause
+    );
+}
+
+size_t Heap::MaxEdenSize() {
+    // Pause of a minor GC is predicted from young bytes and the bytes expected to survive
+    double perByte = minor_cost.Predict(1, statistics.survival_rate);
+    if (perByte <= 0) {
+        return SIZE_MAX;
+    }
+    double young = config.pause_goal / perByte;
+    double survivors = static_cast<double>(survivor_from_space->Size());
+    return young > survivors ? static_cast<size_t>(young - survivors) : 0;
+}
+
+void Heap::UpdateOldGenerationLimit() {
+    size_t live = tenured_space->Size() + large_object_size;
+    old_generation_live = live;
+    size_t young = eden_space->capacity + survivor_from_space->Size();
+    size_t limit = std::max(static_cast<size_t>(live * config.old_generation_growth), config.min_old_generation_size);
+
+    if (config.pause_goal) {
+        // Major GC pause grows with the heap size when it starts, so start it earlier if
+        // it is predicted to exceed the goal. Live objects alone may already exceed
+        // the goal, so leave some headroom to avoid back-to-back major GCs
+        double perByte = major_cost.Predict(1, 0);
+        double fixed = major_cost.Predict(0, static_cast<double>(live + young));
+        if (perByte > 0 && config.pause_goal > fixed) {
+            double goalLimit = (config.pause_goal - fixed) / perByte - young;
+            if (goalLimit < limit) {
+                limit = static_cast<size_t>(std::max<double>(goalLimit, 0));
+            }
+        }
+        limit = std::max(limit, live + std::max(live / 4, config.tenured_size));
+    }
+
+    if (config.soft_heap_limit) {
+        // Collect before the soft limit is crossed, but not over and over when live
+        // objects alone are near it. That is left to the memory pressure listener
+        size_t soft = config.soft_heap_limit > young ? config.soft_heap_limit - young : 0;
+        limit = std::min(limit, std::max(soft, live + config.tenured_size));
+    }
+
+    statistics.old_generation_limit = limit;
+    statistics.predicted_major_pause = major_cost.Predict(
+        static_cast<double>(limit + young),
+        static_cast<double>(live + young)
+    );
+    debug("Old generation limit is set to %zu\n", limit);
+}
+
+bool Heap::OldGenerationFull(size_t size) {
+    return tenured_space->Size() + large_object_size + size > statistics.old_generation_limit;
+}
+
+void Heap::UpdateGarbageEstimates() {
+    // Objects no longer referenced from tenured space, Large Object Space or stack,
+    // and objects only referenced by them, are likely garbage. They might still be
+    // referenced by young objects, which is only found out by marking
+    std::vector<Object*> candidates;
+    for (size_t i = 0; i < unreferenced_count; i++) {
+        Object* object = unreferenced_set[i];
+        if (!object->refcount_) {
+            candidates.push_back(object);
+        } else {
+            object->estimated_ = false;
+        }
+    }
+    unreferenced_count = 0;
+    // Objects allocated or promoted since last update may never have been referenced
+    // from outside of the young generation, so their count never dropped
+    for (MemorySpace* chunk = tenured_space; chunk; chunk = chunk->next) {
+        for (char* ptr = reinterpret_cast<char*>(chunk) + chunk->scanned; ptr < chunk->End(); ptr += reinterpret_cast<Object*>(ptr)->size_) {
+            Object* object = reinterpret_cast<Object*>(ptr);
+            if (!object->refcount_ && !object->estimated_) {
+                object->estimated_ = true;
+                candidates.push_back(object);
+            }
+        }
+        chunk->scanned = chunk->top;
+    }
+    for (size_t i = 0; i < candidates.size(); i++) {
+        candidates[i]->IterateField(GarbageEstimateIterator{ candidates, false });
+    }
+    for (Object* object : candidates) {
+        object->IterateField(GarbageEstimateIterator{ candidates, true });
+    }
+    for (Object* object : candidates) {
+        MemorySpace::Find(object)->garbage += object->size_;
+    }
+}
+
+size_t Heap::Mixed_SelectCollectionSet() {
+    UpdateGarbageEstimates();
+
+    struct Candidate {
+        MemorySpace* chunk;
+        size_t used;
+        size_t garbage;
+    };
+    std::vector<Candidate> candidates;
+    for (MemorySpace* chunk = tenured_space; chunk; chunk = chunk->next) {
+        size_t used = chunk->End() - chunk->Begin();
+        size_t garbage = std::min<size_t>(chunk->garbage, used);
+        if (!used || garbage < used * config.mixed_garbage_ratio) {
+            continue;
+        }
+        // Evacuating would move pinned objects
+        if (pinned_count && HasPinned(chunk, chunk->End())) {
+            continue;
+        }
+        candidates.push_back({ chunk, used, garbage });
+    }
+    if (candidates.empty()) {
+        return 0;
+    }
+    // Chunks with the largest fraction of garbage free the most per byte walked
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        return static_cast<double>(a.garbage) / a.used > static_cast<double>(b.garbage) / b.used;
+    });
+
+    // Add chunks while the predicted pause fits in pause goal, or in the predicted
+    // pause of a major GC if there is no goal. The pause is walked bytes against
+    // survived bytes as for minor GC, with the collection set counted as young
+    double young = static_cast<double>(eden_space->Size() + survivor_from_space->Size());
+    double walked = young;
+    double survived = young * statistics.survival_rate;
+    double budget = config.pause_goal;
+    if (!budget) {
+        budget = major_cost.Predict(
+            static_cast<double>(tenured_space->Size() + large_object_size) + young,
+            static_cast<double>(old_generation_live) + survived
+        );
+    }
+    const CostModel& cost = mixed_cost.Empty() ? major_cost : mixed_cost;
+    size_t count = 0;
+    for (const Candidate& candidate : candidates) {
+        double nextWalked = walked + candidate.used;
+        double nextSurvived = survived + (candidate.used - candidate.garbage);
+        // At least one chunk is taken, so mixed GC makes progress without a prediction
+        if (count && cost.Predict(nextWalked, nextSurvived) > budget) {
+            break;
+        }
+        walked = nextWalked;
+        survived = nextSurvived;
+        count++;
+    }
+
+    collection_set_chunks.clear();
+    for (size_t i = 0; i < count; i++) {
+        collection_set_chunks.push_back(candidates[i].chunk);
+    }
+    std::sort(collection_set_chunks.begin(), collection_set_chunks.end());
+
+    // Unlink the chosen chunks, so evacuated objects will not be placed in them
+    MemorySpace* remaining = nullptr;
+    MemorySpace** remainingTail = &remaining;
+    MemorySpace** setTail = &collection_set;
+    for (MemorySpace* chunk = tenured_space, *next; chunk; chunk = next) {
+        next = chunk->next;
+        chunk->next = nullptr;
+        if (std::binary_search(collection_set_chunks.begin(), collection_set_chunks.end(), chunk)) {
+            *setTail = chunk;
+            setTail = &chunk->next;
+        } else {
+            *remainingTail = chunk;
+            remainingTail = &chunk->next;
+        }
+    }
+    if (!remaining) {
+        remaining = MemorySpace::New(config.tenured_size);
+#if NORLIT_DEBUG_MODE
+        remaining->FillUnallocated(0xCC);
+#endif
+    }
+    tenured_space = remaining;
+    debug("%zu tenured chunks are selected for mixed GC\n", count);
+    return count;
+}
+
+bool Heap::InCollectionSet(Object* object) {
+    if (object->space_ != Space::TENURED_SPACE) {
+        return false;
+    }
+    // Only the last chunk starting before the object can contain it
+    auto iter = std::upper_bound(collection_set_chunks.begin(), collection_set_chunks.end(), static_cast<void*>(object),
+    [](void* ptr, MemorySpace* chunk) {
+        return ptr < static_cast<void*>(chunk);
+    });
+    return iter != collection_set_chunks.begin() && reinterpret_cast<char*>(object) < (*--iter)->End();
+}
+
+void Heap::Mixed_ScanRoot() {
+    // Reference counts act as remembered sets. After discounting references from
+    // the collection set itself, objects with non-zero count are referenced from
+    // outside. This must be done before young roots are scanned
+    for (Object* object : Iterable<MemorySpaceIterator> { collection_set }) {
+        object->IterateField(TrialDecRefIterator{});
+    }
+    for (Object* object : Iterable<MemorySpaceIterator> { collection_set }) {
+        if (object->refcount_) {
+            MarkObject(object);
+        }
+    }
+}
+
+void Heap::Mixed_RestoreRefCount() {
+    // Must be done before destructors are called, as fields of collected objects
+    // cannot be iterated afterwards
+    for (Object* object : Iterable<MemorySpaceIterator> { collection_set }) {
+        if (object->status_ == Status::MARKED) {
+            object->IterateField(TrialIncRefIterator{});
+        } else {
+            object->IterateField(DeadDecRefIterator{});
+        }
+    }
+}
+
+void Heap::CollectOldGeneration(GCReason reason) {
+    if (config.mixed_collections && !mixed_exhausted && Mixed_SelectCollectionSet()) {
+        Mixed_Collect(reason);
+    } else {
+        MajorGC(reason);
+    }
+}
+
 void Heap::Major_CleanLargeObject() {
     LargeObjectSpaceIterator iterator;
     while (iterator.HasNext()) {
@@ -578,32 +2166,38 @@ void Heap::Major_CleanLargeObject() {
     }
 }
 
-void Heap::MinorGC() {
+void Heap::MinorGC(GCReason reason) {
     if (no_gc_counter) {
         throw std::runtime_error{"Minor GC triggered in NoGC scope"};
     }
     debug("----- Minor GC -----\n");
+    BeginEvent(GCType::MINOR, reason);
+    PhaseTimer phase(current_event);
+    // Objects are fully constructed now, and may be destructed soon
+    AllocationProfiler::ResolveTypes();
+
     // Use reference count number assigned by root and tenured generation
-    Minor_ScanRoot(eden_space);
-    Minor_ScanRoot(survivor_from_space);
-
-    // Mark. Note that this step will cause some tenured space's objects to be marked as "MARKED"
-    // TODO: This is super inefficient, use a queue to speed it up
-    while (
-        Mark<MemorySpaceIterator>(eden_space) |
-        Mark<MemorySpaceIterator>(survivor_from_space)
-    );
+    Minor_ScanRoot();
+    phase(GCPhase::SCAN_ROOT);
+
+    // Mark. Note that this step will cause some tenured space's objects to be marked as "MARKING"
+    Mark();
+    ReserveExternalSet(copy_order.size());
+    phase(GCPhase::MARK);
 
     Finalize<MemorySpaceIterator>(eden_space);
     Finalize<MemorySpaceIterator>(survivor_from_space);
+    phase(GCPhase::FINALIZE);
 
     // In case that we may expand tenured space, we need to save it for
     // Minor_UpdateTenuredReference
     tenured_space->SaveOriginal();
 
     // Calculate move target
-    EdenSpace_CalculateTarget();
-    SurvivorSpace_CalculateTarget();
+    std::fill_n(statistics.age_histogram, HeapStatistics::kMaxAge, 0);
+    YoungSpace_CalculateTarget();
+    UpdateTenuringThreshold();
+    phase(GCPhase::CALCULATE_TARGET);
 
     // Weak references holders, if their referred object is collected, will be notified
     // as Java's Reference queue works
@@ -613,18 +2207,33 @@ void Heap::MinorGC() {
     NotifyWeakReference<true, MemorySpaceIterator>({tenured_space, true});
     NotifyWeakReference<true, LargeObjectSpaceIterator>({});
     NotifyWeakReference<true, StackSpaceIterator>({});
+    NotifyWeakReference<true, RememberedSetIterator>({});
+    if (region_space) {
+        NotifyWeakReference<true, MemorySpaceIterator>(region_space);
+    }
+    phase(GCPhase::WEAK);
 
     // Update stack and tenured space reference
     UpdateStackReference();
+    UpdateImmortalReference();
     UpdateNonRootReference<MemorySpaceIterator>(eden_space);
     UpdateNonRootReference<MemorySpaceIterator>(survivor_from_space);
     // We clean the mark of "MARKED" in this step
     UpdateNonStackRootReference<MemorySpaceIterator>({ tenured_space, true });
     UpdateNonStackRootReference<LargeObjectSpaceIterator>({});
+    if (region_space) {
+        // Region objects act as roots while the region is active
+        UpdateNonStackRootReference<MemorySpaceIterator>(region_space);
+    }
+    AllocationProfiler::UpdateLocations();
+    phase(GCPhase::UPDATE);
 
     // Copy
+    UpdateExternalSet();
+    UpdateRegionReferrers();
     MemorySpace_Copy(eden_space);
     MemorySpace_Copy(survivor_from_space);
+    phase(GCPhase::COPY);
 
     // Mark as clear for re-using
     eden_space->Clear();
@@ -639,60 +2248,95 @@ void Heap::MinorGC() {
 
     std::swap(survivor_from_space, survivor_to_space);
 
+    double end = Now();
+    UpdateMinorCost(end - current_event.start);
+    AdjustGenerationSizes(current_event.start, end, current_event.before.eden, survivor_from_space->Size());
+    statistics.predicted_minor_pause = minor_cost.Predict(
+        static_cast<double>(eden_space->capacity + survivor_from_space->Size()),
+        (eden_space->capacity + survivor_from_space->Size()) * statistics.survival_rate
+    );
+
+    if (config.uncommit_delay && last_gc_end - last_release >= config.uncommit_delay) {
+        ReleaseFreeMemory();
+    }
+    phase(GCPhase::CLEANUP);
+    EndEvent();
+
     debug("----- Minor GC Finished -----\n");
 }
 
-void Heap::MajorGC() {
+void Heap::MajorGC(GCReason reason) {
     if (no_gc_counter) {
         throw std::runtime_error{ "Major GC triggered in NoGC scope" };
     }
     debug("----- Major GC -----\n");
+    BeginEvent(GCType::MAJOR, reason);
+    PhaseTimer phase(current_event);
+    AllocationProfiler::ResolveTypes();
+
     // Do not reference count number assigned by root and tenured generation.
     // Start from root all over
     Major_ScanHeapRoot();
+    phase(GCPhase::SCAN_ROOT);
 
     // Mark
-    while (
-        Mark<MemorySpaceIterator>(eden_space) |
-        Mark<MemorySpaceIterator>(survivor_from_space) |
-        Mark<MemorySpaceIterator>(tenured_space) |
-        Mark<LargeObjectSpaceIterator>({})
-    );
+    Mark();
+    ReserveExternalSet(copy_order.size());
+    phase(GCPhase::MARK);
 
     // Call destructors
     Finalize<MemorySpaceIterator>(eden_space);
     Finalize<MemorySpaceIterator>(survivor_from_space);
     Finalize<MemorySpaceIterator>(tenured_space);
     Finalize<LargeObjectSpaceIterator>({});
+    phase(GCPhase::FINALIZE);
 
     // We clean tenured space, meaning that we are going to compact it
     tenured_space->SaveOriginal();
     tenured_space->Clear();
 
     // Calculate move target
-    EdenSpace_CalculateTarget();
+    std::fill_n(statistics.age_histogram, HeapStatistics::kMaxAge, 0);
+    // Young objects go after tenured ones, as some of them are promoted
     TenuredSpace_CalculateTarget();
-    SurvivorSpace_CalculateTarget();
+    YoungSpace_CalculateTarget();
+    UpdateTenuringThreshold();
     // We do not move large target, and their dest_ is set in Finalize<LargeObjectSpaceIterator>({})
+    phase(GCPhase::CALCULATE_TARGET);
 
     NotifyWeakReference<false, MemorySpaceIterator>(eden_space);
     NotifyWeakReference<false, MemorySpaceIterator>(survivor_from_space);
     NotifyWeakReference<false, MemorySpaceIterator>({tenured_space, true});
     NotifyWeakReference<false, LargeObjectSpaceIterator>({});
     NotifyWeakReference<true, StackSpaceIterator>({});
+    NotifyWeakReference<true, RememberedSetIterator>({});
+    if (region_space) {
+        NotifyWeakReference<true, MemorySpaceIterator>(region_space);
+    }
+    phase(GCPhase::WEAK);
 
     // Update stack and tenured space reference
     UpdateStackReference();
+    UpdateImmortalReference();
     UpdateNonRootReference<MemorySpaceIterator>(eden_space);
     UpdateNonRootReference<MemorySpaceIterator>(survivor_from_space);
     UpdateNonRootReference<MemorySpaceIterator>({ tenured_space, true });
     UpdateNonRootReference<LargeObjectSpaceIterator>({});
+    if (region_space) {
+        // Region objects act as roots while the region is active
+        UpdateNonStackRootReference<MemorySpaceIterator>(region_space);
+    }
+    AllocationProfiler::UpdateLocations();
+    phase(GCPhase::UPDATE);
 
     // Copy
+    UpdateExternalSet();
+    UpdateRegionReferrers();
     MemorySpace_Copy(eden_space);
     MemorySpace_Move(tenured_space);
     MemorySpace_Copy(survivor_from_space);
     Major_CleanLargeObject();
+    phase(GCPhase::COPY);
 
     // Mark as clear for re-using
     eden_space->Clear();
@@ -709,9 +2353,183 @@ void Heap::MajorGC() {
 
     std::swap(survivor_from_space, survivor_to_space);
 
+    // Generation sizes are only adjusted according to minor GCs
+    last_gc_end = Now();
+    UpdateMajorCost(last_gc_end - current_event.start);
+    UpdateOldGenerationLimit();
+    mixed_exhausted = false;
+
+    if (config.uncommit_delay && last_gc_end - last_release >= config.uncommit_delay) {
+        ReleaseFreeMemory();
+    } else {
+        // Compaction usually frees a lot of tenured space
+        tenured_space->Decommit();
+    }
+    phase(GCPhase::CLEANUP);
+    EndEvent();
+
     debug("----- Major GC Finished -----\n");
 }
 
+bool Heap::CollectIfIdle(std::chrono::steady_clock::time_point deadline) {
+    if (no_gc_counter || !initialized) {
+        return false;
+    }
+    double budget = std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count();
+    if (budget <= 0) {
+        return false;
+    }
+
+    size_t young = eden_space->Size() + survivor_from_space->Size();
+    double survived = young * statistics.survival_rate;
+
+    // A major GC is the longest pause, so getting it out of the way is most valuable
+    size_t old = tenured_space->Size() + large_object_size;
+    if (!major_cost.Empty() && old >= statistics.old_generation_limit * kIdleOldGenerationOccupancy) {
+        double predicted = major_cost.Predict(
+            static_cast<double>(old + young),
+            static_cast<double>(old_generation_live) + survived
+        );
+        if (predicted * kIdleSafetyFactor <= budget) {
+            MajorGC(GCReason::IDLE);
+            return true;
+        }
+    }
+
+    if (!minor_cost.Empty() && eden_space->Size() >= eden_space->capacity * kIdleEdenOccupancy) {
+        double predicted = minor_cost.Predict(static_cast<double>(young), survived);
+        if (predicted * kIdleSafetyFactor <= budget) {
+            MinorGC(GCReason::IDLE);
+            return true;
+        }
+    }
+    return false;
+}
+
+void Heap::MixedGC(GCReason reason) {
+    if (no_gc_counter) {
+        throw std::runtime_error{ "Mixed GC triggered in NoGC scope" };
+    }
+    if (Mixed_SelectCollectionSet()) {
+        Mixed_Collect(reason);
+    } else {
+        MinorGC(reason);
+    }
+}
+
+void Heap::Mixed_Collect(GCReason reason) {
+    debug("----- Mixed GC -----\n");
+    BeginEvent(GCType::MIXED, reason);
+    PhaseTimer phase(current_event);
+    size_t collected = collection_set->Size();
+    AllocationProfiler::ResolveTypes();
+
+    // Same as minor GC, but the collection set is treated as part of young generation
+    Mixed_ScanRoot();
+    Minor_ScanRoot();
+    phase(GCPhase::SCAN_ROOT);
+
+    Mark();
+    ReserveExternalSet(copy_order.size());
+    Mixed_RestoreRefCount();
+    phase(GCPhase::MARK);
+
+    Finalize<MemorySpaceIterator>(eden_space);
+    Finalize<MemorySpaceIterator>(survivor_from_space);
+    Finalize<MemorySpaceIterator>(collection_set);
+    phase(GCPhase::FINALIZE);
+
+    tenured_space->SaveOriginal();
+
+    std::fill_n(statistics.age_histogram, HeapStatistics::kMaxAge, 0);
+    YoungSpace_CalculateTarget();
+    CollectionSet_CalculateTarget();
+    UpdateTenuringThreshold();
+    phase(GCPhase::CALCULATE_TARGET);
+
+    NotifyWeakReference<false, MemorySpaceIterator>(eden_space);
+    NotifyWeakReference<false, MemorySpaceIterator>(survivor_from_space);
+    NotifyWeakReference<false, MemorySpaceIterator>(collection_set);
+    NotifyWeakReference<true, MemorySpaceIterator>({tenured_space, true});
+    NotifyWeakReference<true, LargeObjectSpaceIterator>({});
+    NotifyWeakReference<true, StackSpaceIterator>({});
+    NotifyWeakReference<true, RememberedSetIterator>({});
+    if (region_space) {
+        NotifyWeakReference<true, MemorySpaceIterator>(region_space);
+    }
+    phase(GCPhase::WEAK);
+
+    UpdateStackReference();
+    UpdateImmortalReference();
+    UpdateNonRootReference<MemorySpaceIterator>(eden_space);
+    UpdateNonRootReference<MemorySpaceIterator>(survivor_from_space);
+    UpdateNonRootReference<MemorySpaceIterator>(collection_set);
+    UpdateNonStackRootReference<MemorySpaceIterator>({ tenured_space, true });
+    UpdateNonStackRootReference<LargeObjectSpaceIterator>({});
+    if (region_space) {
+        // Region objects act as roots while the region is active
+        UpdateNonStackRootReference<MemorySpaceIterator>(region_space);
+    }
+    AllocationProfiler::UpdateLocations();
+    phase(GCPhase::UPDATE);
+
+    UpdateExternalSet();
+    UpdateRegionReferrers();
+    MemorySpace_Copy(eden_space);
+    MemorySpace_Copy(survivor_from_space);
+    MemorySpace_Copy(collection_set);
+    phase(GCPhase::COPY);
+
+    collection_set->Destroy();
+    collection_set = nullptr;
+    collection_set_chunks.clear();
+
+    eden_space->Clear();
+    survivor_from_space->Clear();
+
+    survivor_from_space->Trim(1);
+
+#if NORLIT_DEBUG_MODE
+    eden_space->FillUnallocated(0xCC);
+    survivor_from_space->FillUnallocated(0xCC);
+#endif
+
+    std::swap(survivor_from_space, survivor_to_space);
+
+    last_gc_end = Now();
+    UpdateMixedCost(last_gc_end - current_event.start, collected);
+    // Fall back to major GC next time if not enough is freed
+    if (OldGenerationFull(0)) {
+        mixed_exhausted = true;
+    }
+
+    if (config.uncommit_delay && last_gc_end - last_release >= config.uncommit_delay) {
+        ReleaseFreeMemory();
+    }
+    phase(GCPhase::CLEANUP);
+    EndEvent();
+
+    debug("----- Mixed GC Finished -----\n");
+}
+
+void Heap::ReleaseFreeMemory() {
+    // Blank chunks are unmapped, and unused tails of the rest are decommitted
+    survivor_from_space->Trim();
+    survivor_to_space->Trim();
+    tenured_space->Trim();
+    if (region_pool) {
+        region_pool->Destroy();
+        region_pool = nullptr;
+    }
+
+    eden_space->Decommit();
+    survivor_from_space->Decommit();
+    survivor_to_space->Decommit();
+    tenured_space->Decommit();
+
+    last_release = Now();
+}
+
 void Heap::Dump(const HeapIterator& iter) {
     for (Object* o : Iterable < MemorySpaceIterator > { eden_space }) {
         iter(o);
@@ -722,10 +2540,153 @@ void Heap::Dump(const HeapIterator& iter) {
     }
 
     for (Object* o : Iterable < MemorySpaceIterator > { tenured_space }) {
+        if (!IsFiller(o)) {
+            iter(o);
+        }
+    }
+
+    for (Object* o : Iterable < LargeObjectSpaceIterator > {}) {
         iter(o);
     }
 
+    if (immortal_space) {
+        for (Object* o : Iterable < MemorySpaceIterator > { immortal_space }) {
+            iter(o);
+        }
+    }
+
+    if (frozen_space) {
+        for (Object* o : Iterable < MemorySpaceIterator > { frozen_space }) {
+            iter(o);
+        }
+    }
+
+    if (region_space) {
+        for (Object* o : Iterable < MemorySpaceIterator > { region_space }) {
+            iter(o);
+        }
+    }
+}
+
+void Heap::Dump(const HeapIterator& iter, const std::type_info* type, unsigned threads) {
+    // A piece reports objects that start in it. Chunks without object starts are
+    // walked as a whole
+    struct Piece {
+        MemorySpace* chunk;
+        char* begin;
+        char* end;
+        bool fillers;
+    };
+    std::vector<Piece> pieces;
+    auto split = [&](MemorySpace* space, bool fillers) {
+        for (MemorySpace* chunk = space; chunk; chunk = chunk->next) {
+            if (!chunk->starts) {
+                pieces.push_back({ nullptr, chunk->Begin(), chunk->End(), fillers });
+                continue;
+            }
+            for (char* begin = chunk->Begin(); begin < chunk->End(); begin += kDumpPieceSize) {
+                char* end = chunk->End() - begin > static_cast<ptrdiff_t>(kDumpPieceSize) ? begin + kDumpPieceSize : chunk->End();
+                pieces.push_back({ chunk, begin, end, fillers });
+            }
+        }
+    };
+    split(eden_space, false);
+    split(survivor_from_space, false);
+    // Only tenured chunks hold fillers
+    split(tenured_space, true);
+    split(immortal_space, false);
+    split(frozen_space, false);
+    split(region_space, false);
+
+    std::vector<Object*> large;
     for (Object* o : Iterable < LargeObjectSpaceIterator > {}) {
+        large.push_back(o);
+    }
+
+    size_t count = pieces.size() + large.size();
+    std::atomic<size_t> next{ 0 };
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    auto report = [&](Object* o) {
+        if (!type || typeid(*o) == *type) {
+            iter(o);
+        }
+    };
+    auto work = [&]() {
+        try {
+            for (size_t i; (i = next++) < count;) {
+                if (i >= pieces.size()) {
+                    report(large[i - pieces.size()]);
+                    continue;
+                }
+                const Piece& piece = pieces[i];
+                char* ptr = piece.chunk ? piece.chunk->NextStart(piece.begin) : piece.begin;
+                for (; ptr < piece.end; ptr += reinterpret_cast<Object*>(ptr)->size_) {
+                    Object* o = reinterpret_cast<Object*>(ptr);
+                    if (!piece.fillers || !IsFiller(o)) {
+                        report(o);
+                    }
+                }
+            }
+        } catch (...) {
+            // Stop other workers, and rethrow the first exception on this thread
+            next = count;
+            std::lock_guard<std::mutex> lock{ errorMutex };
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    };
+
+    if (!threads) {
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    threads = static_cast<unsigned>(std::min<size_t>(threads, std::max<size_t>(count, 1)));
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threads; i++) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+Object* Heap::FindObject(const void* address) {
+    const char* ptr = static_cast<const char*>(address);
+    if (MemorySpace* chunk = MemorySpace::Find(ptr)) {
+        char* start = chunk->Begin();
+        if (chunk->starts) {
+            start = chunk->FindStart(ptr);
+        } else {
+            // Chunks loaded by HeapImage have no object starts
+            while (start + reinterpret_cast<Object*>(start)->size_ <= ptr) {
+                start += reinterpret_cast<Object*>(start)->size_;
+            }
+        }
+        Object* object = reinterpret_cast<Object*>(start);
+        return IsFiller(object) ? nullptr : object;
+    }
+
+    // Large objects do not overlap, so only the last one starting at or before
+    // address can contain it
+    auto iter = std::upper_bound(large_object_index.begin(), large_object_index.end(), ptr, [](const char* ptr, Object* object) {
+        return ptr < reinterpret_cast<const char*>(object);
+    });
+    if (iter != large_object_index.begin()) {
+        Object* object = *--iter;
+        if (ptr < reinterpret_cast<const char*>(object) + object->size_) {
+            return object;
+        }
+    }
+    return nullptr;
+}
+
+void Heap::DumpRoots(const HeapIterator& iter) {
+    for (Object* o : Iterable < StackSpaceIterator > {}) {
         iter(o);
     }
 }
\ No newline at end of file
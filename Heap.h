@@ -2,12 +2,97 @@
 #define NORLIT_GC_HEAP_H
 
 #include "Object.h"
+#include "Statistics.h"
+
+#include <chrono>
+#include <typeinfo>
+#include <utility>
+#include <vector>
 
 namespace norlit {
 namespace gc {
 
 struct MemorySpace;
 
+template<typename T>
+class Array;
+template<typename T>
+class ValueArray;
+
+namespace detail {
+class VectorBase;
+class BufferBase;
+class SoftReferenceBase;
+}
+
+// Runtime sizing parameters of the heap. Must be passed to Heap::Configure
+// before the first object is created.
+struct HeapConfig {
+    // Eden Space is a single chunk that is resized between GCs
+    size_t eden_size = 1024 * 1024;
+    size_t max_eden_size = 64 * 1024 * 1024;
+    // Initial size of each survivor space, which is a single chunk resized between
+    // survivor_size and max_survivor_size after minor GCs. When survival spikes the
+    // space expands by chunks of the same size as its first chunk
+    size_t survivor_size = 1024 * 1024;
+    size_t max_survivor_size = 16 * 1024 * 1024;
+    // Chunk size of tenured space
+    size_t tenured_size = 1024 * 1024;
+    // Pre-fault Eden Space, so allocation bursts do not suffer from first-touch page faults
+    bool prefault_eden = false;
+
+    // Objects larger than this will be allocated in Large Object Space
+    size_t large_object_threshold = 4096;
+    // Objects that survive more than this number of GCs will be promoted.
+    // With adaptive sizing this is the upper bound of the tenuring threshold
+    uint8_t tenuring_threshold = 16;
+
+    // Resize eden and survivor and adjust tenuring threshold after each GC
+    // according to the goals below
+    bool adaptive = true;
+    // Desired fraction of max_survivor_size occupied by survivors. Tenuring threshold
+    // is lowered when survivors exceed it
+    double target_survivor_ratio = 0.5;
+
+    // Allocate objects created by Heap::New<T> directly in tenured space
+    // once this fraction of young objects of type T are promoted. Pretenured
+    // objects are sampled at major GC, and T is allocated young again once fewer
+    // than this fraction of them live until then
+    bool pretenuring = true;
+    double pretenure_ratio = 0.9;
+
+    // Release all free heap memory to the OS if it has not been done for this
+    // number of seconds, checked at the end of each GC. 0 to disable
+    double uncommit_delay = 60;
+    // Target fraction of time spent in GC
+    double gc_time_ratio = 0.05;
+    // Target maximum pause in seconds, 0 for no goal. Eden is sized so that the
+    // predicted minor GC pause meets it, and major GCs are started earlier when
+    // the predicted major GC pause would exceed it
+    double pause_goal = 0;
+
+    // Major GC is started when tenured and large objects grow to this factor of
+    // their size after last major GC, but not before they reach min_old_generation_size
+    double old_generation_growth = 2;
+    size_t min_old_generation_size = 16 * 1024 * 1024;
+
+    // When the old generation limit is reached, try a mixed GC first, which evacuates
+    // tenured chunks with an estimated garbage fraction of at least mixed_garbage_ratio,
+    // as many as fit in pause_goal, or in the predicted pause of a major GC if there is
+    // no goal. A major GC is done if that does not free enough
+    bool mixed_collections = true;
+    double mixed_garbage_ratio = 0.5;
+
+    // Heap size that should not be exceeded, e.g. somewhat below the container memory
+    // limit. 0 for none. Major GCs are started before it is reached, and when the heap
+    // is still larger after a GC the memory pressure listener is called
+    size_t soft_heap_limit = 0;
+    // A soft reference is cleared by GC once it has not been accessed for this many
+    // seconds per MB of free heap, unless its target is otherwise reachable. Free heap
+    // is measured against soft_heap_limit if set, and the old generation limit otherwise
+    double soft_reference_seconds_per_mb = 1;
+};
+
 class HeapIterator {
   public:
     virtual void operator()(Object* obj) const = 0;
@@ -19,15 +104,26 @@ class Heap {
     struct IncRefIterator;
     struct DecRefIterator;
     struct WeakRefNotifyIterator;
+    struct TrialDecRefIterator;
+    struct TrialIncRefIterator;
+    struct DeadDecRefIterator;
+    struct GarbageEstimateIterator;
+    struct MortalReferenceIterator;
+    struct RegionTrialIterator;
+    struct RegionDeadDecRefIterator;
+    struct RegionEscapeIterator;
+    struct RegionWeakIterator;
     template<typename T>
     class Iterable;
     class StackSpaceIterator;
     class MemorySpaceIterator;
     class LargeObjectSpaceIterator;
+    class RememberedSetIterator;
+    class PhaseTimer;
+    class CostModel;
+    class Filler;
 
-    static const size_t LARGE_OBJECT_THRESHOLD = 4096;
-    static const size_t MEMORY_SPACE_SIZE = 1024 * 1024;
-    static const size_t TENURED_SPACE_THRESHOLD = 16;
+    static HeapConfig config;
 
     struct LargeObjectNode {
         LargeObjectNode* prev;
@@ -36,36 +132,177 @@ class Heap {
     static bool initialized;
     static Object stack_space;
     static LargeObjectNode large_object_space;
+    // Large objects sorted by address, for FindObject
+    static std::vector<Object*> large_object_index;
     static MemorySpace* eden_space;
     static MemorySpace* survivor_from_space;
     static MemorySpace* survivor_to_space;
     static MemorySpace* tenured_space;
+    // Tenured chunks being evacuated by a mixed GC. They are unlinked from tenured_space
+    static MemorySpace* collection_set;
+    // The same chunks sorted by address, for InCollectionSet
+    static std::vector<MemorySpace*> collection_set_chunks;
+    // Set when a mixed GC does not bring the old generation under limit
+    static bool mixed_exhausted;
+    // Chunks of Immortal Space that objects created by NewImmortal are allocated in
+    static MemorySpace* immortal_space;
+    // Immortal chunks that are never written by GC or allocation: chunks loaded by
+    // HeapImage, and chunks frozen by FreezeImmortal
+    static MemorySpace* frozen_space;
+    // Chunks of the active region, linked at head. Null when no region is active
+    static MemorySpace* region_space;
+    // Blank chunks kept for next regions
+    static MemorySpace* region_pool;
+    // Number of nested Region scopes. Only the outermost one has its own space
+    static uintptr_t region_depth;
+    // Objects marked but not yet scanned. next is the field to continue scanning
+    // from, so objects with many fields are scanned in slices of kMarkSliceSize
+    struct MarkEntry {
+        Object* object;
+        size_t next;
+    };
+    static const size_t kMarkSliceSize = 1024;
+    static std::vector<MarkEntry> mark_worklist;
+    // Chunks are split into pieces of this size to be dumped in parallel
+    static const size_t kDumpPieceSize = 256 * 1024;
+    // Worklist index of the object referenced by a hot field of the object being scanned
+    static size_t mark_hot_entry;
+    // Young objects in the order they are scanned, which is the order they are copied in
+    static std::vector<Object*> copy_order;
+    // Immortal objects that may reference mortal objects, and are therefore roots.
+    // Membership is flagged by status_ MARKED, which immortal objects do not use otherwise
+    static Object** remembered_set;
+    static size_t remembered_count;
+    static size_t remembered_capacity;
+    // Young objects whose reference count became non-zero, as references from outside
+    // of the young generation are counted. Entries whose count dropped to zero again
+    // are removed lazily. Membership is flagged by external_
+    static Object** external_set;
+    static size_t external_count;
+    static size_t external_capacity;
+    // Tenured objects whose reference count dropped to zero since garbage estimates of
+    // chunks were last updated. Membership is flagged by estimated_, which stays set
+    // once the object is part of the estimate
+    static Object** unreferenced_set;
+    static size_t unreferenced_count;
+    static size_t unreferenced_capacity;
+    // Set from BeginEvent to EndEvent. Reference counts GC drops are either restored
+    // or belong to objects GC finds out about anyway, so they are not recorded
+    static bool collecting;
+    // Objects outside of the active region that region references were stored into.
+    // Membership is flagged by referrer_
+    static std::vector<Object*> region_referrers;
 
     // Size of allocating object. Passed from Allocate() to Initialize()
     static uint32_t allocating_size;
     // Object that allocating_size refers to
     static void* allocating_object;
+    // Allocation site of allocating_object. Passed from New() to Initialize()
+    static uint8_t allocating_site;
+    // Whether allocating_object should be placed in tenured space
+    static bool allocating_tenured;
+    // Whether allocating_object should be placed in immortal space
+    static bool allocating_immortal;
+    // Whether allocating_object should be placed in Large Object Space regardless of size
+    static bool allocating_pinned;
+    // For pinned objects, the address allocating_alignment_offset bytes into the object
+    // is aligned to allocating_alignment if it is non-zero. At most a page
+    static size_t allocating_alignment;
+    static size_t allocating_alignment_offset;
+    // Whether allocating_object is placed in region_space
+    static bool allocating_region;
+    // Number of pins on tenured objects. Chunks are only searched for pinned objects
+    // when it is non-zero
+    static size_t pinned_count;
+
+    // Allocation sites are tracked per type for pretenuring
+    struct AllocationSite {
+        const char* name;
+        // Objects that are promoted or died in young generation during current sampling window
+        uint32_t promoted;
+        uint32_t died;
+        bool pretenured;
+    };
+    static const size_t kMaxAllocationSite = 256;
+    static const uint32_t kPretenureSampleSize = 256;
+    static AllocationSite allocation_sites[kMaxAllocationSite];
+    static size_t allocation_site_count;
 
-    // Suggest a full gc is needed. Set when tenured space is expanded
-    static bool full_gc_suggested;
     static uintptr_t no_gc_counter;
+    // End of last GC, in seconds from an arbitrary epoch. Used by the adaptive policy
+    static double last_gc_end;
+    static HeapStatistics statistics;
+    // Bytes allocated in Large Object Space
+    static size_t large_object_size;
+    // Value of statistics.allocated when last GC started
+    static size_t allocated_before_gc;
+
+    // Ring buffer of recent GC events. The one being collected is current_event
+    static const size_t kEventHistory = 64;
+    static GCEvent events[kEventHistory];
+    static GCEvent current_event;
+    static GCEventListener* event_listener;
+    static MemoryPressureListener* pressure_listener;
+    // Start of current or last GC, used as the access time of soft references.
+    // Soft references not accessed for soft_max_age are treated as weak in this GC
+    static double soft_clock;
+    static double soft_max_age;
+    // Last time free memory is released to the OS
+    static double last_release;
+    // Pause time predictors. Minor GC pause is fitted against young bytes collected
+    // and bytes survived, major GC pause against heap size before and after
+    static CostModel minor_cost;
+    static CostModel major_cost;
+    // Mixed GC pause against young bytes and collection set size, and bytes survived
+    static CostModel mixed_cost;
+    // Size of tenured and large objects after last major GC
+    static size_t old_generation_live;
+    // Idle GC is only done when its predicted pause times this factor fits before deadline
+    static constexpr double kIdleSafetyFactor = 1.5;
+    // and eden or the old generation is at least this full
+    static constexpr double kIdleEdenOccupancy = 0.5;
+    static constexpr double kIdleOldGenerationOccupancy = 0.75;
 
     static void GlobalInitialize();
     static void GlobalDestroy();
 
-    static void Minor_ScanRoot(MemorySpace* space);
+    static void Minor_ScanRoot();
     static void Major_ScanHeapRoot();
     static void Major_CleanLargeObject();
+    static void UpdateGarbageEstimates();
+    static size_t Mixed_SelectCollectionSet();
+    static void Mixed_ScanRoot();
+    static void Mixed_RestoreRefCount();
+    static void Mixed_Collect(GCReason reason);
+    static bool InCollectionSet(Object* object);
+    static bool HasPinned(MemorySpace* chunk, char* end);
+    static void MakeFiller(Object* object);
+    static bool IsFiller(Object* object);
+    static void CollectOldGeneration(GCReason reason);
 
     // Minor/Major GC indepedent methods
-    template<typename I>
-    static bool Mark(Iterable<I> iter);
+    static bool Traced(Object* object);
+    static bool IsDead(Object* object);
+    static void MarkObject(Object* object);
+    static void Mark();
     template<typename I>
     static void Finalize(Iterable<I> iter);
     template<bool asRoot, typename I>
     static void NotifyWeakReference(Iterable<I> iter);
 
     static void UpdateStackReference();
+    static void UpdateImmortalReference();
+    static void PruneRememberedSet();
+    static void Remember(Object* object);
+    static void RecordExternal(Object* object);
+    static void ReserveExternalSet(size_t count);
+    static void PruneExternalSet();
+    static void RecordUnreferenced(Object* object);
+    static void PruneUnreferencedSet();
+    static void UpdateExternalSet();
+    static void RecordRegionReferrer(Object* object);
+    static void UpdateRegionReferrers();
+    static bool IsCounted(Object* object);
     template<typename I>
     static void UpdateNonRootReference(Iterable<I> iter);
     template<typename I>
@@ -76,23 +313,154 @@ class Heap {
     static void MemorySpace_Move(MemorySpace* space);
 
     static void PromoteToTenuredSpace(Object* object);
+    static void RecordSiteSurvival(Object* object, bool promoted);
+    static uint8_t RegisterAllocationSite(const char* name);
+    static void FinishTenuredAllocation(Object* object);
 
-    static void EdenSpace_CalculateTarget();
-    static void SurvivorSpace_CalculateTarget();
+    static void YoungSpace_CalculateTarget();
     static void TenuredSpace_CalculateTarget();
+    static void CollectionSet_CalculateTarget();
+
+    static void RecordSurvivor(Object* object);
+    static void UpdateTenuringThreshold();
+    static void AdjustGenerationSizes(double start, double end, size_t allocated, size_t survived);
+    static void UpdateMinorCost(double pause);
+    static void UpdateMajorCost(double pause);
+    static void UpdateMixedCost(double pause, size_t collected);
+    static size_t MaxEdenSize();
+    static void UpdateOldGenerationLimit();
+    static bool OldGenerationFull(size_t size);
+    static double Now();
+    static SpaceUsage Usage();
+    static void BeginEvent(GCType type, GCReason reason);
+    static void EndEvent();
 
     static void UntrackStackObject(Object* object);
     static void Initialize(Object* object);
+    static void RecordAllocation(void* object, size_t size);
     static void* Allocate(size_t size);
+    static void* AllocateImmortal(size_t size);
+    static void* AllocateInRegion(size_t size);
+    static void EnterRegion();
+    static void ExitRegion();
+    // Resize a large object in place by remapping its pages, which may move it.
+    // Returns the new location, or nullptr if object is not large, cannot be
+    // remapped, or growing it needs a GC first. Only valid for objects referenced
+    // solely by the caller
+    static Object* ResizeLargeObject(Object* object, size_t size);
   public:
-    static void MinorGC();
-    static void MajorGC();
+    static void Configure(const HeapConfig&);
+    static const HeapConfig& Config();
+    static const HeapStatistics& Statistics();
+    // Copy at most count most recent GC events to buffer, from oldest to newest.
+    // Returns number of events copied
+    static size_t RecentEvents(GCEvent* buffer, size_t count);
+    // Listener is called at the end of each GC. Pass nullptr to remove
+    static void SetEventListener(GCEventListener* listener);
+    // Listener is called at the end of a GC that leaves the heap larger than
+    // HeapConfig::soft_heap_limit. Pass nullptr to remove
+    static void SetMemoryPressureListener(MemoryPressureListener* listener);
+
+    static void MinorGC(GCReason reason = GCReason::EXPLICIT);
+    static void MajorGC(GCReason reason = GCReason::EXPLICIT);
+    // Collect young generation and the tenured chunks with most garbage. This is
+    // a minor GC if no chunk is worth evacuating
+    static void MixedGC(GCReason reason = GCReason::EXPLICIT);
+    // Do a GC if it is worth doing and predicted to finish before deadline. A major
+    // GC is preferred when the old generation is near its limit, otherwise a minor
+    // GC when eden is mostly full. Returns whether a GC is done
+    static bool CollectIfIdle(std::chrono::steady_clock::time_point deadline);
+    // Return free memory of all spaces to the OS
+    static void ReleaseFreeMemory();
     static void Dump(const HeapIterator&);
+    // Like Dump, but only reports objects whose dynamic type is type, or all objects if
+    // type is null. The heap is split among threads workers, or one per core if 0, so
+    // iter is called concurrently, in no particular order. It must not allocate or
+    // modify references
+    static void Dump(const HeapIterator& iter, const std::type_info* type, unsigned threads = 0);
+    // The heap object whose memory contains address, or null. Stack objects are not found.
+    // Takes O(log n) time in the number of chunks and large objects
+    static Object* FindObject(const void* address);
+    // Iterate through stack space objects, which act as roots
+    static void DumpRoots(const HeapIterator&);
+
+    // Create an object in tenured space directly, skipping survivor spaces.
+    // NewTenured, NewPinned, NewImmortal and New create T with plain new, so they
+    // do not work for arrays, whose size depends on their length; use
+    // Array<T>::NewTenured, ValueArray<T>::NewTenured and ValueArray<T>::NewPinned
+    // instead. Vector, ValueVector and String are only created with their own New
+    template<typename T, typename... Args>
+    static T* NewTenured(Args&&... args);
+
+    // Keep an object at its current address until Unpin, so its memory can be passed
+    // to system calls. Pins nest. Stack, large and immortal objects are never moved,
+    // so pinning them does nothing. Young objects cannot be pinned, as every minor
+    // GC moves them; create objects to be pinned with NewPinned, or with NewTenured
+    // to pin them only for a while. Pinned objects are still collected when unreachable
+    static void Pin(const Handle<Object>& object);
+    static void Unpin(Object* object);
+    // Create an object that is never moved, in Large Object Space regardless of its
+    // size. Each such object takes at least one page
+    template<typename T, typename... Args>
+    static T* NewPinned(Args&&... args);
+
+    // Create an object in Immortal Space. It is never marked, moved or finalized,
+    // and its memory is never reclaimed. Objects it references are kept alive
+    template<typename T, typename... Args>
+    static T* NewImmortal(Args&&... args);
+    // Make all immortal objects read-only with memory protection, so writing to
+    // them faults. Throws if an immortal object still references a mortal object.
+    // Objects created by NewImmortal afterwards are writable until next freeze
+    static void FreezeImmortal();
+
+    // Create an object with its survival tracked by its type. Once objects of
+    // the type are found to be long-lived they will be created in tenured space
+    template<typename T, typename... Args>
+    static T* New(Args&&... args);
 
     friend class Object;
     friend class NoGC;
+    friend class Region;
+    friend class HeapImage;
+    friend class detail::VectorBase;
+    friend class detail::BufferBase;
+    friend class detail::SoftReferenceBase;
+    template<typename T>
+    friend class Array;
+    template<typename T>
+    friend class ValueArray;
 };
 
+template<typename T, typename... Args>
+T* Heap::NewTenured(Args&&... args) {
+    allocating_tenured = true;
+    T* object = new T(std::forward<Args>(args)...);
+    FinishTenuredAllocation(object);
+    return object;
+}
+
+template<typename T, typename... Args>
+T* Heap::NewPinned(Args&&... args) {
+    allocating_pinned = true;
+    return new T(std::forward<Args>(args)...);
+}
+
+template<typename T, typename... Args>
+T* Heap::NewImmortal(Args&&... args) {
+    allocating_immortal = true;
+    return new T(std::forward<Args>(args)...);
+}
+
+template<typename T, typename... Args>
+T* Heap::New(Args&&... args) {
+    static uint8_t site = RegisterAllocationSite(typeid(T).name());
+    allocating_site = site;
+    if (allocation_sites[site].pretenured) {
+        return NewTenured<T>(std::forward<Args>(args)...);
+    }
+    return new T(std::forward<Args>(args)...);
+}
+
 class NoGC {
   public:
     NoGC() {
@@ -105,6 +473,23 @@ class NoGC {
     void operator =(const NoGC&) = delete;
 };
 
+// Objects created while a Region is alive are bump allocated in a separate arena
+// instead of eden, and are not moved by GC. When the region ends, objects that are
+// still referenced from outside of it, and objects reachable from them, are moved
+// into tenured space with their chunks; the rest are freed at once without GC.
+// Nested regions share the outermost one
+class Region {
+  public:
+    Region() {
+        Heap::EnterRegion();
+    }
+    ~Region() {
+        Heap::ExitRegion();
+    }
+    Region(const Region&) = delete;
+    void operator =(const Region&) = delete;
+};
+
 }
 }
 
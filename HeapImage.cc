@@ -0,0 +1,295 @@
+#include "HeapImage.h"
+#include "Heap.h"
+#include "MemorySpace.h"
+#include "Platform.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+using namespace norlit::gc;
+
+namespace {
+
+const char kMagic[8] = { 'N', 'G', 'C', 'I', 'M', 'A', 'G', 'E' };
+// Chunk offset is aligned to the largest common page size, so the chunk is page aligned
+const size_t kChunkAlignment = 64 * 1024;
+// Address images are written for. Far away from where heaps and libraries are usually mapped
+const uint64_t kPreferredBase = sizeof(void*) == 8 ? 0x100000000000ull : 0x50000000ull;
+
+// Registered types. Function-local, so types can be registered during static initialization
+std::unordered_map<std::string, const void*>& VtablesByName() {
+    static std::unordered_map<std::string, const void*> vtables;
+    return vtables;
+}
+
+std::unordered_map<const void*, std::string>& NamesByVtable() {
+    static std::unordered_map<const void*, std::string> names;
+    return names;
+}
+
+const void* Vtable(const Object* object) {
+    return *reinterpret_cast<const void* const*>(object);
+}
+
+template<typename T>
+void Append(std::vector<char>& buffer, T value) {
+    const char* data = reinterpret_cast<const char*>(&value);
+    buffer.insert(buffer.end(), data, data + sizeof(T));
+}
+
+template<typename T>
+bool Read(FILE* file, T& value) {
+    return fread(&value, sizeof(T), 1, file) == 1;
+}
+
+}
+
+class HeapImage::Collector : public FieldIterator {
+    std::unordered_map<Object*, size_t>& offsets;
+    std::vector<Object*>& objects;
+    size_t& size;
+
+  public:
+    Collector(std::unordered_map<Object*, size_t>& offsets, std::vector<Object*>& objects, size_t& size)
+        :offsets(offsets), objects(objects), size(size) {}
+
+    void Add(Object* obj) const {
+        if (!obj || obj->IsTagged() || offsets.count(obj)) {
+            return;
+        }
+        assert(obj->space_ != Space::STACK_SPACE);
+        offsets[obj] = size;
+        objects.push_back(obj);
+        size += obj->size_;
+    }
+
+    virtual void operator()(Object** field) const override {
+        Add(*field);
+    }
+
+    virtual void operator()(Object** field, decltype(weak)) const override {
+        Add(*field);
+    }
+};
+
+// When writing, stores references of original into copy as addresses in the image.
+// When loading, shifts references by delta
+class HeapImage::Relocator : public FieldIterator {
+    Object* original = nullptr;
+    char* copy = nullptr;
+    const std::unordered_map<Object*, size_t>* offsets = nullptr;
+    uint64_t dataBase = 0;
+    intptr_t delta = 0;
+
+    void Relocate(Object** field) const {
+        Object* obj = *field;
+        if (!obj || obj->IsTagged()) {
+            return;
+        }
+        if (offsets) {
+            char* slot = copy + (reinterpret_cast<char*>(field) - reinterpret_cast<char*>(original));
+            uintptr_t target = static_cast<uintptr_t>(dataBase + offsets->at(obj));
+            memcpy(slot, &target, sizeof(target));
+        } else {
+            *field = reinterpret_cast<Object*>(reinterpret_cast<char*>(obj) + delta);
+        }
+    }
+
+  public:
+    Relocator(Object* original, char* copy, const std::unordered_map<Object*, size_t>& offsets, uint64_t dataBase)
+        :original(original), copy(copy), offsets(&offsets), dataBase(dataBase) {}
+
+    Relocator(intptr_t delta) :delta(delta) {}
+
+    virtual void operator()(Object** field) const override {
+        Relocate(field);
+    }
+
+    virtual void operator()(Object** field, decltype(weak)) const override {
+        Relocate(field);
+    }
+};
+
+void HeapImage::RegisterType(const Object& sample) {
+    const char* name = typeid(sample).name();
+    const void* vtable = Vtable(&sample);
+    VtablesByName()[name] = vtable;
+    NamesByVtable()[vtable] = name;
+}
+
+bool HeapImage::Write(const char* path, Object* root) {
+    if (!root || root->IsTagged() || root->space_ == Space::STACK_SPACE) {
+        throw std::invalid_argument{ "Heap image root must be a heap object" };
+    }
+    NoGC noGC;
+
+    // Collect objects reachable from root, and lay them out in discovery order
+    std::unordered_map<Object*, size_t> offsets;
+    std::vector<Object*> objects;
+    size_t size = 0;
+    Collector collector{ offsets, objects, size };
+    collector.Add(root);
+    for (size_t i = 0; i < objects.size(); i++) {
+        objects[i]->IterateField(collector);
+    }
+
+    // Type table, in order of first use
+    std::vector<const void*> types;
+    std::unordered_map<const void*, bool> seen;
+    for (Object* object : objects) {
+        const void* vtable = Vtable(object);
+        if (seen[vtable]) {
+            continue;
+        }
+        seen[vtable] = true;
+        if (!NamesByVtable().count(vtable)) {
+            throw std::runtime_error{ std::string("Type not registered for heap image: ") + typeid(*object).name() };
+        }
+        types.push_back(vtable);
+    }
+
+    std::vector<char> file;
+    file.insert(file.end(), kMagic, kMagic + sizeof(kMagic));
+    Append<uint32_t>(file, kVersion);
+    Append<uint32_t>(file, sizeof(void*));
+    size_t baseOffset = file.size();
+    Append<uint64_t>(file, kPreferredBase);
+    // Chunk offset, chunk size and root are filled in below
+    Append<uint64_t>(file, 0);
+    Append<uint64_t>(file, 0);
+    Append<uint64_t>(file, 0);
+    Append<uint32_t>(file, static_cast<uint32_t>(types.size()));
+    for (const void* vtable : types) {
+        const std::string& name = NamesByVtable()[vtable];
+        Append<uint64_t>(file, reinterpret_cast<uintptr_t>(vtable));
+        Append<uint32_t>(file, static_cast<uint32_t>(name.size()));
+        file.insert(file.end(), name.begin(), name.end());
+    }
+
+    // The chunk is a MemorySpace, so it can be walked like other spaces once loaded
+    size_t chunkOffset = (file.size() + kChunkAlignment - 1) &~(kChunkAlignment - 1);
+    size_t dataOffset = offsetof(MemorySpace, data);
+    size_t pageSize = Platform::PageSize();
+    size_t chunkSize = (dataOffset + size + pageSize - 1) &~(pageSize - 1);
+    file.resize(chunkOffset + chunkSize);
+
+    MemorySpace* chunk = reinterpret_cast<MemorySpace*>(&file[chunkOffset]);
+    chunk->top = dataOffset + size;
+    chunk->capacity = chunkSize;
+    chunk->topOriginal = chunk->top;
+    chunk->next = nullptr;
+    chunk->starts = nullptr;
+
+    uint64_t dataBase = kPreferredBase + dataOffset;
+    for (Object* object : objects) {
+        size_t offset = offsets[object];
+        char* copy = &file[chunkOffset + dataOffset + offset];
+        memcpy(copy, static_cast<void*>(object), object->size_);
+        object->IterateField(Relocator{ object, copy, offsets, dataBase });
+
+        Object* header = reinterpret_cast<Object*>(copy);
+        header->dest_ = reinterpret_cast<Object*>(static_cast<uintptr_t>(dataBase + offset));
+        header->refcount_ = 0;
+        header->space_ = Space::IMMORTAL_SPACE;
+        header->status_ = Status::NOT_MARKED;
+        header->lifetime_ = 0;
+        header->site_ = 0;
+        header->pins_ = 0;
+        header->referrer_ = false;
+        header->estimated_ = false;
+        header->external_ = false;
+    }
+
+    uint64_t fields[] = { chunkOffset, chunkSize, dataBase + offsets[root] };
+    memcpy(&file[baseOffset + sizeof(uint64_t)], fields, sizeof(fields));
+
+    FILE* output = fopen(path, "wb");
+    if (!output) {
+        return false;
+    }
+    bool ok = fwrite(file.data(), 1, file.size(), output) == file.size();
+    return fclose(output) == 0 && ok;
+}
+
+Object* HeapImage::Load(const char* path) {
+    FILE* input = fopen(path, "rb");
+    if (!input) {
+        return nullptr;
+    }
+
+    char magic[sizeof(kMagic)];
+    uint32_t version, pointerSize, typeCount;
+    uint64_t base, chunkOffset, chunkSize, root;
+    bool ok = fread(magic, sizeof(magic), 1, input) == 1 && !memcmp(magic, kMagic, sizeof(kMagic)) &&
+              Read(input, version) && version == kVersion &&
+              Read(input, pointerSize) && pointerSize == sizeof(void*) &&
+              Read(input, base) && Read(input, chunkOffset) && Read(input, chunkSize) &&
+              Read(input, root) && Read(input, typeCount);
+
+    // Map vtables recorded in the image to those of this process
+    std::unordered_map<uintptr_t, const void*> vtables;
+    bool relocateVtables = false;
+    for (uint32_t i = 0; ok && i < typeCount; i++) {
+        uint64_t vtable;
+        uint32_t length;
+        ok = Read(input, vtable) && Read(input, length);
+        std::string name(ok ? length : 0, '\0');
+        ok = ok && (!length || fread(&name[0], length, 1, input) == 1);
+        if (!ok) {
+            break;
+        }
+        auto iter = VtablesByName().find(name);
+        if (iter == VtablesByName().end()) {
+            fclose(input);
+            throw std::runtime_error{ "Type not registered for heap image: " + name };
+        }
+        vtables[static_cast<uintptr_t>(vtable)] = iter->second;
+        relocateVtables |= reinterpret_cast<uintptr_t>(iter->second) != vtable;
+    }
+    fclose(input);
+    if (!ok) {
+        return nullptr;
+    }
+
+    // Map at the address the image is written for, so nothing needs to be relocated
+    size_t size;
+    char* mapping = static_cast<char*>(Platform::MapFile(path, size, reinterpret_cast<void*>(base - chunkOffset)));
+    if (!mapping) {
+        return nullptr;
+    }
+    if (chunkOffset + chunkSize > size) {
+        Platform::UnmapFile(mapping, size);
+        return nullptr;
+    }
+
+    MemorySpace* chunk = reinterpret_cast<MemorySpace*>(mapping + chunkOffset);
+    intptr_t delta = reinterpret_cast<char*>(chunk) - reinterpret_cast<char*>(static_cast<uintptr_t>(base));
+    if (delta || relocateVtables) {
+        debug("Heap image %s is relocated\n", path);
+        for (char* ptr = chunk->Begin(); ptr < chunk->End(); ptr += reinterpret_cast<Object*>(ptr)->size_) {
+            Object* object = reinterpret_cast<Object*>(ptr);
+            if (relocateVtables) {
+                *reinterpret_cast<const void**>(object) = vtables.at(reinterpret_cast<uintptr_t>(Vtable(object)));
+            }
+            if (delta) {
+                object->dest_ = object;
+                object->IterateField(Relocator{ delta });
+            }
+        }
+    }
+
+    try {
+        MemorySpace::Register(chunk);
+    } catch (...) {
+        Platform::UnmapFile(mapping, size);
+        throw;
+    }
+    chunk->next = Heap::frozen_space;
+    Heap::frozen_space = chunk;
+    return reinterpret_cast<Object*>(static_cast<uintptr_t>(root + delta));
+}
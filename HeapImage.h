@@ -0,0 +1,59 @@
+#ifndef NORLIT_GC_HEAPIMAGE_H
+#define NORLIT_GC_HEAPIMAGE_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace norlit {
+namespace gc {
+
+class Object;
+
+// Saves a graph of objects to a file that another process can map directly
+// into its heap. Loaded objects are placed in Immortal Space, where they are
+// never moved or collected, so they cost nothing in GC until written to.
+// The file is mapped copy-on-write at the address it is written for when
+// possible, in which case pages that are not written are shared between
+// processes. Otherwise references and vtables are relocated on load.
+//
+// Objects must only hold references and plain data, since other pointers
+// (such as those owned by std::string) cannot be relocated. Their types must
+// be registered with RegisterType in both processes.
+//
+// File format (native byte order):
+//   Header: "NGCIMAGE", uint32 version, uint32 pointer size, uint64 base,
+//     uint64 chunk offset, uint64 chunk size, uint64 root, uint32 type count
+//   Per type: uint64 vtable address, uint32 name length, name (mangled, not terminated)
+//   At chunk offset: a memory space chunk holding the objects, with all
+//     references pointing into the chunk as if it is mapped at base
+class HeapImage {
+    class Collector;
+    class Relocator;
+
+  public:
+    static const uint32_t kVersion = 3;
+
+    // Record the vtable of T. T must be default constructible; the instance is
+    // created on stack
+    template<typename T>
+    static void RegisterType() {
+        T sample;
+        RegisterType(sample);
+    }
+
+    // Record the vtable of the dynamic type of sample
+    static void RegisterType(const Object& sample);
+
+    // Write root and all objects reachable from it. Returns false if the file
+    // cannot be written. Throws if an object has an unregistered type
+    static bool Write(const char* path, Object* root);
+
+    // Map an image into the heap and return its root. Returns nullptr if the file
+    // cannot be read or is not a valid image. Throws if a type is unregistered
+    static Object* Load(const char* path);
+};
+
+}
+}
+
+#endif
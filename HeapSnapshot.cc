@@ -0,0 +1,169 @@
+#include "HeapSnapshot.h"
+#include "Heap.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <typeinfo>
+#include <unordered_map>
+
+using namespace norlit::gc;
+
+namespace {
+
+// Buffered writer, so each object does not cost a call into stdio
+class Writer {
+    static const size_t kBufferSize = 1024 * 1024;
+
+    FILE* file;
+    char* buffer;
+    size_t used = 0;
+    bool failed;
+
+  public:
+    Writer(FILE* file) :file(file) {
+        buffer = static_cast<char*>(malloc(kBufferSize));
+        failed = !buffer;
+    }
+
+    ~Writer() {
+        free(buffer);
+    }
+
+    Writer(const Writer&) = delete;
+    void operator =(const Writer&) = delete;
+
+    void Flush() {
+        if (!failed && used && fwrite(buffer, 1, used, file) != used) {
+            failed = true;
+        }
+        used = 0;
+    }
+
+    void Write(const void* data, size_t size) {
+        if (failed) {
+            return;
+        }
+        if (used + size > kBufferSize) {
+            Flush();
+        }
+        memcpy(buffer + used, data, size);
+        used += size;
+    }
+
+    template<typename T>
+    void Write(T value) {
+        Write(&value, sizeof(T));
+    }
+
+    bool Failed() const {
+        return failed;
+    }
+};
+
+class EdgeCounter : public FieldIterator {
+  public:
+    mutable uint32_t count = 0;
+
+    virtual void operator()(Object** field) const override {
+        if (*field && !(*field)->IsTagged()) {
+            count++;
+        }
+    }
+
+    virtual void operator()(Object** field, decltype(weak)) const override {
+        operator()(field);
+    }
+};
+
+class EdgeWriter : public FieldIterator {
+    Writer& writer;
+
+    void Write(Object* target, uint8_t flags) const {
+        if (target && !target->IsTagged()) {
+            writer.Write<uint64_t>(reinterpret_cast<uintptr_t>(target));
+            writer.Write<uint8_t>(flags);
+        }
+    }
+
+  public:
+    EdgeWriter(Writer& writer) :writer(writer) {}
+
+    virtual void operator()(Object** field) const override {
+        Write(*field, 0);
+    }
+
+    virtual void operator()(Object** field, decltype(weak)) const override {
+        Write(*field, HeapSnapshot::kWeakEdge);
+    }
+};
+
+}
+
+class HeapSnapshot::NodeWriter : public HeapIterator {
+    Writer& writer;
+    // Keyed by type_info::name(), which is unique per type
+    std::unordered_map<const char*, uint32_t>& types;
+
+  public:
+    NodeWriter(Writer& writer, std::unordered_map<const char*, uint32_t>& types) :
+        writer(writer), types(types) {}
+
+    virtual void operator()(Object* object) const override {
+        const char* name = typeid(*object).name();
+        auto iter = types.find(name);
+        uint32_t type;
+        if (iter == types.end()) {
+            type = static_cast<uint32_t>(types.size());
+            types.emplace(name, type);
+            uint32_t length = static_cast<uint32_t>(strlen(name));
+            writer.Write<char>('T');
+            writer.Write<uint32_t>(type);
+            writer.Write<uint32_t>(length);
+            writer.Write(name, length);
+        } else {
+            type = iter->second;
+        }
+
+        bool stack = object->space_ == Space::STACK_SPACE;
+        EdgeCounter counter;
+        object->IterateField(counter);
+
+        writer.Write<char>('N');
+        writer.Write<uint64_t>(reinterpret_cast<uintptr_t>(object));
+        writer.Write<uint32_t>(type);
+        // size_ and lifetime_ are not available for stack objects
+        writer.Write<uint32_t>(stack ? 0 : object->size_);
+        writer.Write<uint8_t>(static_cast<uint8_t>(object->space_));
+        writer.Write<uint8_t>(stack ? 0 : object->lifetime_);
+        writer.Write<uint32_t>(counter.count);
+        object->IterateField(EdgeWriter{ writer });
+    }
+};
+
+bool HeapSnapshot::Write(const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+    bool success = Write(file);
+    return fclose(file) == 0 && success;
+}
+
+bool HeapSnapshot::Write(FILE* file) {
+    // Objects must not be moved while we are writing their addresses
+    NoGC noGC;
+
+    Writer writer(file);
+    writer.Write("NGCHEAP1", 8);
+    writer.Write<uint32_t>(kVersion);
+    writer.Write<uint32_t>(sizeof(void*));
+
+    std::unordered_map<const char*, uint32_t> types;
+    NodeWriter nodeWriter(writer, types);
+    Heap::DumpRoots(nodeWriter);
+    Heap::Dump(nodeWriter);
+
+    writer.Write<char>('E');
+    writer.Flush();
+    return !writer.Failed() && fflush(file) == 0;
+}
@@ -0,0 +1,41 @@
+#ifndef NORLIT_GC_HEAPSNAPSHOT_H
+#define NORLIT_GC_HEAPSNAPSHOT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+namespace norlit {
+namespace gc {
+
+class Object;
+
+// Streams a binary snapshot of the heap, containing every object with its
+// type, size, space, age and outgoing references. Nothing is allocated on
+// the GC heap while writing, and no GC can happen.
+//
+// File format (native byte order):
+//   Header: "NGCHEAP1", uint32 version, uint32 pointer size
+//   Records, each starting with a one-byte tag:
+//     'T' uint32 type id, uint32 name length, name (mangled, not terminated)
+//       Emitted before the first node of the type.
+//     'N' uint64 address, uint32 type id, uint32 size, uint8 space, uint8 age,
+//       uint32 edge count, then per edge: uint64 target address, uint8 flags
+//       Stack space objects are roots and have size 0. Flag 1 means weak.
+//     'E' end of snapshot
+class HeapSnapshot {
+    class NodeWriter;
+
+  public:
+    static const uint32_t kVersion = 1;
+    static const uint8_t kWeakEdge = 1;
+
+    // Returns false if the file cannot be written
+    static bool Write(const char* path);
+    static bool Write(FILE* file);
+};
+
+}
+}
+
+#endif
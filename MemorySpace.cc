@@ -2,14 +2,58 @@
 #include "MemorySpace.h"
 #include "Platform.h"
 
+#include <algorithm>
 #include <cstring>
 #include <new>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 using namespace norlit::gc;
 
+namespace {
+
+// Size of the object-start bitmap of a chunk
+size_t StartsSize(size_t capacity) {
+    size_t pageSize = Platform::PageSize();
+    return ((capacity + 63) / 64 + pageSize - 1) &~(pageSize - 1);
+}
+
+// All chunks, sorted by address. Chunks may be created during static initialization,
+// so this is constructed on first use
+std::vector<MemorySpace*>& Chunks() {
+    static std::vector<MemorySpace*> chunks;
+    return chunks;
+}
+
+int LowestBit(uint64_t bits) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(bits);
+#endif
+}
+
+int HighestBit(uint64_t bits) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, bits);
+    return static_cast<int>(index);
+#else
+    return 63 - __builtin_clzll(bits);
+#endif
+}
+
+}
+
 MemorySpace::MemorySpace(size_t capacity) :capacity(capacity) {
     top = reinterpret_cast<char*>(data)-reinterpret_cast<char*>(this);
     topOriginal = top;
+    scanned = top;
 }
 
 void* MemorySpace::Allocate(size_t size, bool expand) {
@@ -28,11 +72,89 @@ void* MemorySpace::Allocate(size_t size, bool expand) {
     }
     void* ret = reinterpret_cast<char*>(this) + top;
     top += size;
+    SetStart(ret);
     return ret;
 }
 
-MemorySpace* MemorySpace::New(size_t capacity) {
-    return new(Platform::Allocate(capacity))MemorySpace(capacity);
+MemorySpace* MemorySpace::New(size_t capacity, bool populate) {
+    capacity = Platform::RoundSize(capacity);
+    void* memory = Platform::Allocate(capacity, populate);
+    uint64_t* starts;
+    try {
+        starts = static_cast<uint64_t*>(Platform::Allocate(StartsSize(capacity)));
+    } catch (...) {
+        Platform::Free(memory, capacity);
+        throw;
+    }
+    MemorySpace* space = new(memory)MemorySpace(capacity);
+    space->starts = starts;
+    try {
+        Register(space);
+    } catch (...) {
+        Platform::Free(starts, StartsSize(capacity));
+        Platform::Free(memory, capacity);
+        throw;
+    }
+    return space;
+}
+
+void MemorySpace::Register(MemorySpace* chunk) {
+    std::vector<MemorySpace*>& chunks = Chunks();
+    chunks.insert(std::upper_bound(chunks.begin(), chunks.end(), chunk), chunk);
+}
+
+MemorySpace* MemorySpace::Find(const void* address) {
+    // Chunks do not overlap, so only the last chunk starting at or before address
+    // can contain it
+    std::vector<MemorySpace*>& chunks = Chunks();
+    auto iter = std::upper_bound(chunks.begin(), chunks.end(), address, [](const void* address, MemorySpace* chunk) {
+        return static_cast<const char*>(address) < reinterpret_cast<const char*>(chunk);
+    });
+    if (iter == chunks.begin()) {
+        return nullptr;
+    }
+    MemorySpace* chunk = *--iter;
+    const char* ptr = static_cast<const char*>(address);
+    return ptr >= chunk->Begin() && ptr < chunk->End() ? chunk : nullptr;
+}
+
+char* MemorySpace::FindStart(const void* address) {
+    const char* ptr = static_cast<const char*>(address);
+    if (ptr < Begin() || ptr >= End()) {
+        return nullptr;
+    }
+    // Begin() always has its bit set here, so the scan stops there at the latest
+    uintptr_t index = static_cast<uintptr_t>(ptr - reinterpret_cast<char*>(this)) >> 3;
+    uintptr_t word = index >> 6;
+    uint64_t bits = starts[word] & (~static_cast<uint64_t>(0) >> (63 - (index & 63)));
+    while (!bits) {
+        bits = starts[--word];
+    }
+    return reinterpret_cast<char*>(this) + ((word << 6 | HighestBit(bits)) << 3);
+}
+
+char* MemorySpace::NextStart(const void* address) {
+    const char* ptr = static_cast<const char*>(address);
+    if (ptr >= End()) {
+        return End();
+    }
+    if (ptr < Begin()) {
+        ptr = Begin();
+    }
+    uintptr_t index = (static_cast<uintptr_t>(ptr - reinterpret_cast<char*>(this)) + 7) >> 3;
+    if (index >= top >> 3) {
+        return End();
+    }
+    uintptr_t word = index >> 6;
+    uintptr_t lastWord = ((top >> 3) - 1) >> 6;
+    uint64_t bits = starts[word] & (~static_cast<uint64_t>(0) << (index & 63));
+    while (!bits) {
+        if (word == lastWord) {
+            return End();
+        }
+        bits = starts[++word];
+    }
+    return reinterpret_cast<char*>(this) + ((word << 6 | LowestBit(bits)) << 3);
 }
 
 void MemorySpace::FillUnallocated(uint8_t data) {
@@ -46,9 +168,40 @@ void MemorySpace::Destroy() {
     if (next) {
         next->Destroy();
     }
+    std::vector<MemorySpace*>& chunks = Chunks();
+    chunks.erase(std::lower_bound(chunks.begin(), chunks.end(), this));
+    if (starts) {
+        Platform::Free(starts, StartsSize(capacity));
+    }
     Platform::Free(this, capacity);
 }
 
+void MemorySpace::Decommit() {
+    // Chunks are page aligned, so only the unallocated pages after top are released
+    size_t pageSize = Platform::PageSize();
+    uintptr_t begin = (top + pageSize - 1) &~(pageSize - 1);
+    if (begin < capacity) {
+        Platform::Decommit(reinterpret_cast<char*>(this) + begin, capacity - begin);
+    }
+    // Bits after top are clear, so their pages can be released too
+    size_t startsSize = StartsSize(capacity);
+    uintptr_t startsBegin = ((top + 63) / 64 + pageSize - 1) &~(pageSize - 1);
+    if (starts && startsBegin < startsSize) {
+        Platform::Decommit(reinterpret_cast<char*>(starts) + startsBegin, startsSize - startsBegin);
+    }
+    if (next) {
+        next->Decommit();
+    }
+}
+
+size_t MemorySpace::Size() {
+    size_t size = End() - Begin();
+    if (next) {
+        size += next->Size();
+    }
+    return size;
+}
+
 void MemorySpace::Trim(size_t allowedBlankSpace) {
     if (next) {
         bool nextBlank = next->Begin() == next->End();
@@ -3,17 +3,34 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <cstring>
 
 namespace norlit {
 namespace gc {
 
 struct MemorySpace {
-    static MemorySpace* New(size_t capacity);
+    // Capacity is rounded according to platform options. If populate is true,
+    // the chunk is pre-faulted
+    static MemorySpace* New(size_t capacity, bool populate = false);
+    // Chunk whose [Begin(), End()) contains address, among chunks created by New and
+    // chunks added by Register, or nullptr. Takes O(log n) time in the number of chunks
+    static MemorySpace* Find(const void* address);
+    // Make a chunk that is not created by New, such as one loaded by HeapImage, known
+    // to Find. It is never removed
+    static void Register(MemorySpace* chunk);
 
     uintptr_t top;
     uintptr_t capacity;
     uintptr_t topOriginal;
     MemorySpace* next = nullptr;
+    // Object-start bitmap, one bit for each 8 bytes of the chunk. Bits are set by
+    // Allocate, and bits at or after top are always clear. Null for chunks loaded by
+    // HeapImage, which are walked from Begin() instead
+    uint64_t* starts = nullptr;
+    // Kept by Heap for tenured chunks: estimated bytes of dead objects in the chunk,
+    // and the offset up to which objects were checked for being unreferenced
+    uintptr_t garbage = 0;
+    uintptr_t scanned;
     uintptr_t data[1];
 
   private:
@@ -23,7 +40,16 @@ struct MemorySpace {
     void FillUnallocated(uint8_t);
     void Destroy();
     void Trim(size_t = 0);
+    void Decommit();
+    size_t Size();
     void* Allocate(size_t size, bool expand = false);
+    // Start of the allocation in this chunk that contains address, or nullptr if
+    // address is not in [Begin(), End())
+    char* FindStart(const void* address);
+    // First allocation in this chunk that starts at or after address, or End()
+    char* NextStart(const void* address);
+
+    inline void SetStart(const void* address);
 
     inline void Clear();
     inline void SaveOriginal();
@@ -51,8 +77,18 @@ inline char* MemorySpace::End() {
     return reinterpret_cast<char*>(this) + top;
 }
 
+inline void MemorySpace::SetStart(const void* address) {
+    uintptr_t offset = static_cast<uintptr_t>(static_cast<const char*>(address) - reinterpret_cast<char*>(this)) >> 3;
+    starts[offset >> 6] |= static_cast<uint64_t>(1) << (offset & 63);
+}
+
 inline void MemorySpace::Clear() {
+    if (starts) {
+        memset(starts, 0, ((top >> 3) + 63) / 64 * sizeof(uint64_t));
+    }
     top = reinterpret_cast<char*>(data)-reinterpret_cast<char*>(this);
+    garbage = 0;
+    scanned = top;
     if (next) {
         next->Clear();
     }
@@ -4,10 +4,15 @@
 #include "Handle.h"
 
 #include <cstdio>
+#include <cstring>
 
 using namespace norlit::gc;
 
 decltype(FieldIterator::weak) FieldIterator::weak;
+decltype(FieldIterator::soft) FieldIterator::soft;
+decltype(FieldIterator::hot) FieldIterator::hot;
+
+bool Object::region_entered = false;
 
 Object::Object() {
     Heap::Initialize(this);
@@ -20,10 +25,18 @@ Object::~Object() {
 }
 
 void Object::SlowWriteBarrier(Object** slot, Object* data) {
+    if (data && !data->IsTagged() && data->space_ == Space::REGION_SPACE && space_ != Space::REGION_SPACE && !referrer_) {
+        RecordRegionReferrer();
+    }
     switch (space_) {
+        case Space::IMMORTAL_SPACE:
+            // GC needs to treat immortal objects holding references as roots
+            Heap::Remember(this);
+        // fallthrough
         case Space::STACK_SPACE:
         case Space::TENURED_SPACE:
         case Space::LARGE_OBJECT_SPACE:
+        case Space::REGION_SPACE:
             if (data && !data->IsTagged()) {
                 data->IncRefCount();
             }
@@ -37,10 +50,89 @@ void Object::SlowWriteBarrier(Object** slot, Object* data) {
     }
 }
 
+void Object::RecordExternal() {
+    Heap::RecordExternal(this);
+}
+
+void Object::RecordRegionReferrer() {
+    Heap::RecordRegionReferrer(this);
+}
+
+void Object::RecordUnreferenced() {
+    Heap::RecordUnreferenced(this);
+}
+
+void Object::CopyWriteBarrier(Object** slots, Object* const* data, size_t count) {
+    if (space_ != Space::REGION_SPACE && !referrer_) {
+        for (size_t i = 0; i < count; i++) {
+            if (data[i] && !data[i]->IsTagged() && data[i]->space_ == Space::REGION_SPACE) {
+                RecordRegionReferrer();
+                break;
+            }
+        }
+    }
+    switch (space_) {
+        case Space::EDEN_SPACE:
+        case Space::SURVIVOR_SPACE:
+            break;
+        case Space::IMMORTAL_SPACE:
+            Heap::Remember(this);
+        // fallthrough
+        default:
+            // Count new references before dropping old ones, as the ranges may overlap
+            for (size_t i = 0; i < count; i++) {
+                if (data[i] && !data[i]->IsTagged()) {
+                    data[i]->IncRefCount();
+                }
+            }
+            for (size_t i = 0; i < count; i++) {
+                if (slots[i] && !slots[i]->IsTagged()) {
+                    slots[i]->DecRefCount();
+                }
+            }
+            break;
+    }
+    memmove(slots, data, count * sizeof(Object*));
+}
+
+void Object::FillWriteBarrier(Object** slots, Object* data, size_t count) {
+    if (data && !data->IsTagged() && data->space_ == Space::REGION_SPACE && space_ != Space::REGION_SPACE && !referrer_) {
+        RecordRegionReferrer();
+    }
+    switch (space_) {
+        case Space::EDEN_SPACE:
+        case Space::SURVIVOR_SPACE:
+            break;
+        case Space::IMMORTAL_SPACE:
+            Heap::Remember(this);
+        // fallthrough
+        default:
+            for (size_t i = 0; i < count; i++) {
+                if (slots[i] && !slots[i]->IsTagged()) {
+                    slots[i]->DecRefCount();
+                }
+            }
+            if (data && !data->IsTagged()) {
+                for (size_t i = 0; i < count; i++) {
+                    data->IncRefCount();
+                }
+            }
+            break;
+    }
+    for (size_t i = 0; i < count; i++) {
+        slots[i] = data;
+    }
+}
+
 void Object::IterateField(const FieldIterator& iter) {
 
 }
 
+size_t Object::IterateFieldSlice(const FieldIterator& iter, size_t begin, size_t count) {
+    IterateField(iter);
+    return 0;
+}
+
 void Object::NotifyWeakReferenceCollected(Object** slot) {
 
 }
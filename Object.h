@@ -23,9 +23,23 @@ class HandleGroup;
 class FieldIterator {
   public:
     static class {} weak;
+    // Soft fields keep their target alive as strong fields while Heap decides to,
+    // and are weak fields otherwise. See SoftReference
+    static class {} soft;
+    // Hot fields are strong fields whose target is placed right after the object
+    // when both are copied, for fields that are followed often. The last hot field
+    // reported wins
+    static class {} hot;
 
     virtual void operator()(Object** field) const = 0;
     virtual void operator()(Object** field, decltype(weak)) const = 0;
+    // Only marking treats soft fields differently from weak fields
+    virtual void operator()(Object** field, decltype(soft)) const {
+        operator()(field, weak);
+    }
+    virtual void operator()(Object** field, decltype(hot)) const {
+        operator()(field);
+    }
 
     template<typename T>
     void operator()(T** field) const {
@@ -36,6 +50,16 @@ class FieldIterator {
     void operator()(T** field, decltype(weak)) const {
         operator()(reinterpret_cast<Object**>(field), weak);
     }
+
+    template<typename T>
+    void operator()(T** field, decltype(soft)) const {
+        operator()(reinterpret_cast<Object**>(field), soft);
+    }
+
+    template<typename T>
+    void operator()(T** field, decltype(hot)) const {
+        operator()(reinterpret_cast<Object**>(field), hot);
+    }
 };
 
 class Object {
@@ -62,11 +86,38 @@ class Object {
     Status status_;
     // # of gcs the object survived
     uint8_t lifetime_;
+    // Allocation site used for pretenuring, 0 if not tracked
+    uint8_t site_;
+    // Number of Heap::Pin calls not yet undone. Pinned objects are never moved
+    uint8_t pins_;
+    // Set while the object is in the region referrers of Heap, i.e. it is outside of
+    // the active region and references were stored into region objects through
+    // the write barrier. Region exit scans referrers for references into the region
+    bool referrer_;
+    // Young objects only. Set while the object is in the externally referenced set
+    // of Heap, which minor GC takes roots from
+    bool external_;
+    // Tenured objects only. Set once Heap found the reference count of the object
+    // zero, until the count is found non-zero or GC finds the object alive. Its size
+    // is then part of the garbage estimate of its chunk, or is about to be
+    bool estimated_;
+
+    // Set by Heap while a region is entered. Region objects exist only then, so the
+    // young fast path of the write barrier checks it before loading the stored object
+    static bool region_entered;
+
+    // Used by Heap for fillers, which take the place of dead objects and are not
+    // allocated or tracked
+    struct NoInitialize {};
+    explicit Object(NoInitialize) {}
 
     inline void IncRefCount();
     inline void DecRefCount();
 
     void SlowWriteBarrier(Object** slot, Object* data);
+    void RecordExternal();
+    void RecordRegionReferrer();
+    void RecordUnreferenced();
 
   protected:
     inline void WriteBarrier(Object** slot, Object* data);
@@ -76,6 +127,11 @@ class Object {
     inline void WriteBarrier(T** slot, std::nullptr_t);
     template<typename T>
     inline void WriteBarrier(T** slot, const Handle<T>& data);
+    // Store count references from data into slots, running the write barrier once
+    // for the whole range. The ranges may overlap
+    void CopyWriteBarrier(Object** slots, Object* const* data, size_t count);
+    // Store data into count slots
+    void FillWriteBarrier(Object** slots, Object* data, size_t count);
 
     virtual void NotifyWeakReferenceCollected(Object** slot);
 
@@ -93,12 +149,19 @@ class Object {
     virtual bool Equals(const Handle<Object>& object);
 
     virtual void IterateField(const FieldIterator&);
+    // Iterate through at most count fields starting from field begin. Returns the
+    // field to continue from, or 0 when done. Objects with many fields override this,
+    // so GC can scan them in bounded steps
+    virtual size_t IterateFieldSlice(const FieldIterator&, size_t begin, size_t count);
 
     static void* operator new(size_t);
     static void* operator new[](size_t) = delete;
     static void operator delete(void*);
 
     friend class Heap;
+    friend class AllocationProfiler;
+    friend class HeapSnapshot;
+    friend class HeapImage;
     friend class detail::HandleGroup;
 };
 
@@ -110,6 +173,9 @@ inline void Object::WriteBarrier(Object** slot, Object* data) {
     switch (space_) {
         case Space::EDEN_SPACE:
         case Space::SURVIVOR_SPACE:
+            if (region_entered && data && !data->IsTagged() && data->space_ == Space::REGION_SPACE && !referrer_) {
+                RecordRegionReferrer();
+            }
             *slot = data;
             break;
         default:
@@ -135,12 +201,26 @@ inline void Object::WriteBarrier(T** slot, const Handle<T>& data) {
 
 inline void Object::IncRefCount() {
     assert(space_ != Space::STACK_SPACE);
-    refcount_++;
+    // Immortal objects are never collected. They are not counted so image pages stay shared
+    if (space_ != Space::IMMORTAL_SPACE) {
+        refcount_++;
+        // Young objects referenced from outside of the young generation are minor GC roots
+        if (!external_ && (space_ == Space::EDEN_SPACE || space_ == Space::SURVIVOR_SPACE)) {
+            RecordExternal();
+        }
+    }
 }
 
 inline void Object::DecRefCount() {
     assert(space_ != Space::STACK_SPACE);
-    refcount_--;
+    if (space_ != Space::IMMORTAL_SPACE) {
+        refcount_--;
+        // Tenured objects no longer referenced from outside of the young generation
+        // are likely garbage
+        if (!refcount_ && space_ == Space::TENURED_SPACE && !estimated_) {
+            RecordUnreferenced();
+        }
+    }
 }
 
 }
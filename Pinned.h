@@ -0,0 +1,43 @@
+#ifndef NORLIT_GC_PINNED_H
+#define NORLIT_GC_PINNED_H
+
+#include "Handle.h"
+#include "Heap.h"
+
+namespace norlit {
+namespace gc {
+
+// Keeps an object alive and at a fixed address while in scope
+template<typename T>
+class Pinned {
+    Handle<T> object;
+
+  public:
+    Pinned(const Handle<T>& obj) :object(obj) {
+        Heap::Pin(object);
+    }
+
+    ~Pinned() {
+        Heap::Unpin(object);
+    }
+
+    Pinned(const Pinned&) = delete;
+    void operator =(const Pinned&) = delete;
+
+    T* operator ->() const {
+        return object.operator->();
+    }
+
+    T* Get() const {
+        return object;
+    }
+
+    const Handle<T>& GetHandle() const {
+        return object;
+    }
+};
+
+}
+}
+
+#endif
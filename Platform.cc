@@ -1,25 +1,106 @@
-#include "platform.h"
+#include "Platform.h"
 
+#include <cstdint>
 #include <cstdlib>
 #include <new>
 
 #ifdef _WIN32
 #include <windows.h>
 #else
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 using namespace norlit::gc;
 
-void* Platform::Allocate(size_t size) {
+PlatformOptions Platform::options;
+
+void Platform::Configure(const PlatformOptions& newOptions) {
+    options = newOptions;
+}
+
+const PlatformOptions& Platform::Options() {
+    return options;
+}
+
+size_t Platform::RoundSize(size_t size) {
+    size_t granularity = options.huge_pages ? kHugePageSize : PageSize();
+    return (size + granularity - 1) &~(granularity - 1);
+}
+
+#ifndef _WIN32
+namespace {
+
+void* AllocateHugePage(size_t size, bool populate) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_HUGETLB
+    if (Platform::Options().huge_tlb) {
+        void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB | (populate ? MAP_POPULATE : 0), -1, 0);
+        if (addr != MAP_FAILED) {
+            return addr;
+        }
+        // No huge pages reserved, fallback to transparent huge pages
+    }
+#endif
+
+    // Over-allocate and cut off the unaligned head and tail
+    void* addr = mmap(NULL, size + Platform::kHugePageSize, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (addr == MAP_FAILED) {
+        return addr;
+    }
+    uintptr_t begin = reinterpret_cast<uintptr_t>(addr);
+    uintptr_t aligned = (begin + Platform::kHugePageSize - 1) &~(Platform::kHugePageSize - 1);
+    if (aligned != begin) {
+        munmap(addr, aligned - begin);
+    }
+    munmap(reinterpret_cast<void*>(aligned + size), begin + Platform::kHugePageSize - aligned);
+    addr = reinterpret_cast<void*>(aligned);
+
+#ifdef MADV_HUGEPAGE
+    madvise(addr, size, MADV_HUGEPAGE);
+#endif
+    // MAP_POPULATE would fault in small pages before MADV_HUGEPAGE takes effect
+    if (populate) {
+#ifdef MADV_POPULATE_WRITE
+        if (madvise(addr, size, MADV_POPULATE_WRITE) == 0) {
+            return addr;
+        }
+#endif
+        // Not supported by the kernel. Writing to every page faults it in the same way
+        size_t pageSize = Platform::PageSize();
+        for (size_t offset = 0; offset < size; offset += pageSize) {
+            static_cast<volatile char*>(addr)[offset] = 0;
+        }
+    }
+    return addr;
+}
+
+}
+#endif
+
+void* Platform::Allocate(size_t size, bool populate) {
 #ifdef _WIN32
+    // Large pages require SeLockMemoryPrivilege on Windows, so huge page options are ignored
     void* addr = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
     if (!addr) {
         throw std::bad_alloc{};
     }
     return addr;
 #else
-    void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    void* addr;
+    if (options.huge_pages && size % kHugePageSize == 0) {
+        addr = AllocateHugePage(size, populate);
+    } else {
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_POPULATE
+        if (populate) {
+            flags |= MAP_POPULATE;
+        }
+#endif
+        addr = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+    }
     if(addr == MAP_FAILED) {
         throw std::bad_alloc{};
     }
@@ -33,4 +114,96 @@ void Platform::Free(void* ptr, size_t size) {
 #else
     munmap(ptr, size);
 #endif
-}
\ No newline at end of file
+}
+
+void Platform::Decommit(void* ptr, size_t size) {
+    if (!size) {
+        return;
+    }
+#ifdef _WIN32
+    // MEM_RESET keeps stale contents until pages are reused, so pages are decommitted
+    // and committed again. Committed pages get physical memory once touched
+    VirtualFree(ptr, size, MEM_DECOMMIT);
+    if (!VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE)) {
+        throw std::bad_alloc{};
+    }
+#else
+    madvise(ptr, size, MADV_DONTNEED);
+#endif
+}
+
+void* Platform::Reallocate(void* ptr, size_t size, size_t newSize) {
+#ifdef MREMAP_MAYMOVE
+    void* addr = mremap(ptr, size, newSize, MREMAP_MAYMOVE);
+    return addr == MAP_FAILED ? nullptr : addr;
+#else
+    return nullptr;
+#endif
+}
+
+void Platform::Protect(void* ptr, size_t size) {
+#ifdef _WIN32
+    DWORD old;
+    VirtualProtect(ptr, size, PAGE_READONLY, &old);
+#else
+    mprotect(ptr, size, PROT_READ);
+#endif
+}
+
+size_t Platform::PageSize() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    static size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return pageSize;
+#endif
+}
+
+void* Platform::MapFile(const char* path, size_t& size, void* hint) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+    LARGE_INTEGER fileSize;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(file, &fileSize)) {
+        mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    }
+    CloseHandle(file);
+    if (!mapping) {
+        return nullptr;
+    }
+    void* addr = MapViewOfFileEx(mapping, FILE_MAP_COPY, 0, 0, 0, hint);
+    if (!addr) {
+        addr = MapViewOfFileEx(mapping, FILE_MAP_COPY, 0, 0, 0, NULL);
+    }
+    CloseHandle(mapping);
+    size = static_cast<size_t>(fileSize.QuadPart);
+    return addr;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat info;
+    void* addr = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        size = static_cast<size_t>(info.st_size);
+        // Private mapping, so pages are shared between processes until written
+        addr = mmap(hint, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    return addr == MAP_FAILED ? nullptr : addr;
+#endif
+}
+
+void Platform::UnmapFile(void* ptr, size_t size) {
+#ifdef _WIN32
+    UnmapViewOfFile(ptr);
+#else
+    munmap(ptr, size);
+#endif
+}
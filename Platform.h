@@ -6,10 +6,44 @@
 namespace norlit {
 namespace gc {
 
+struct PlatformOptions {
+    // Align allocations that are multiples of huge page size to huge page
+    // boundaries, and advise the OS to back them with transparent huge pages
+    bool huge_pages = false;
+    // Try explicit huge pages (MAP_HUGETLB) first, falling back to transparent
+    // huge pages if none are reserved. Only used when huge_pages is set
+    bool huge_tlb = false;
+};
+
 class Platform {
+    static PlatformOptions options;
+
   public:
-    static void* Allocate(size_t size);
+    static const size_t kHugePageSize = 2 * 1024 * 1024;
+
+    // Options only affect allocations made afterwards
+    static void Configure(const PlatformOptions&);
+    static const PlatformOptions& Options();
+    // Round a size so that it can take advantage of the configured options
+    static size_t RoundSize(size_t size);
+
+    // If populate is true, pages will be pre-faulted
+    static void* Allocate(size_t size, bool populate = false);
     static void Free(void* ptr, size_t size);
+    // Return physical pages to the OS. The range must be page aligned. It stays
+    // accessible, and will be zero-filled when touched again. On Windows the range is
+    // committed again, which throws std::bad_alloc if the commit limit is reached
+    static void Decommit(void* ptr, size_t size);
+    // Grow or shrink a mapping made by Allocate, moving it if needed. Contents are
+    // kept and added pages are zero-filled. Returns nullptr if it cannot be remapped,
+    // in which case the original mapping is untouched
+    static void* Reallocate(void* ptr, size_t size, size_t newSize);
+    // Make pages read-only. The range must be page aligned
+    static void Protect(void* ptr, size_t size);
+    static size_t PageSize();
+    // Map a file copy-on-write, preferably at hint. Returns nullptr on failure
+    static void* MapFile(const char* path, size_t& size, void* hint = nullptr);
+    static void UnmapFile(void* ptr, size_t size);
 };
 
 }
@@ -0,0 +1,28 @@
+#include "SoftReference.h"
+#include "Heap.h"
+
+using namespace norlit::gc;
+using namespace norlit::gc::detail;
+
+SoftReferenceBase::SoftReferenceBase(Object* referent) :last_access(Heap::soft_clock) {
+    WriteBarrier(&this->referent, referent);
+}
+
+Object* SoftReferenceBase::Get() {
+    last_access = Heap::soft_clock;
+    return referent;
+}
+
+void SoftReferenceBase::Set(Object* referent) {
+    last_access = Heap::soft_clock;
+    WriteBarrier(&this->referent, referent);
+}
+
+void SoftReferenceBase::IterateField(const FieldIterator& iter) {
+    // Decided by the policy of current GC, so all passes of a GC agree
+    if (Heap::soft_clock - last_access <= Heap::soft_max_age) {
+        iter(&referent, FieldIterator::soft);
+    } else {
+        iter(&referent, FieldIterator::weak);
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef NORLIT_GC_SOFTREFERENCE_H
+#define NORLIT_GC_SOFTREFERENCE_H
+
+#include "Object.h"
+#include "Handle.h"
+
+namespace norlit {
+namespace gc {
+namespace detail {
+
+// Holds its referent strongly while it is recently accessed and memory is plentiful,
+// and weakly otherwise. See HeapConfig::soft_reference_seconds_per_mb
+class SoftReferenceBase : public Object {
+    Object* referent = nullptr;
+    // Value of Heap::soft_clock when last accessed
+    double last_access;
+
+  protected:
+    SoftReferenceBase(Object* referent);
+
+    Object* Get();
+    void Set(Object* referent);
+
+    virtual void IterateField(const FieldIterator&) override;
+};
+
+}
+
+template<typename T>
+class SoftReference : public detail::SoftReferenceBase {
+    SoftReference(T* referent) :SoftReferenceBase(referent) {}
+
+  public:
+    // Null once the referent is collected. Counts as an access
+    Handle<T> Get() {
+        return static_cast<T*>(SoftReferenceBase::Get());
+    }
+
+    void Set(const Handle<T>& referent) {
+        SoftReferenceBase::Set(referent);
+    }
+
+    static Handle<SoftReference> New(const Handle<T>& referent) {
+        return new SoftReference(referent);
+    }
+};
+
+}
+}
+
+#endif
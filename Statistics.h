@@ -0,0 +1,128 @@
+#ifndef NORLIT_GC_STATISTICS_H
+#define NORLIT_GC_STATISTICS_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace norlit {
+namespace gc {
+
+enum class GCType : uint8_t {
+    MINOR,
+    MAJOR,
+    // Young generation together with a few garbage-dense chunks of tenured space
+    MIXED
+};
+
+enum class GCReason : uint8_t {
+    // Requested by user through Heap::MinorGC or Heap::MajorGC
+    EXPLICIT,
+    // Eden Space is full
+    EDEN_FULL,
+    // Eden Space is full, and tenured and large objects exceed the old generation limit
+    OLD_GENERATION_FULL,
+    // Allocation of a large object exceeds the old generation limit
+    LARGE_OBJECT,
+    // Stress GC in debug mode
+    DEBUG,
+    // Heap::CollectIfIdle
+    IDLE
+};
+
+enum class GCPhase : uint8_t {
+    SCAN_ROOT,
+    MARK,
+    FINALIZE,
+    CALCULATE_TARGET,
+    WEAK,
+    UPDATE,
+    COPY,
+    // Clearing, trimming and resizing spaces
+    CLEANUP,
+    COUNT
+};
+
+// Bytes used in each space
+struct SpaceUsage {
+    size_t eden;
+    size_t survivor;
+    size_t tenured;
+    size_t large_object;
+
+    size_t Total() const {
+        return eden + survivor + tenured + large_object;
+    }
+};
+
+struct GCEvent {
+    // Sequence number of the GC, starting from 1
+    uint64_t id;
+    GCType type;
+    GCReason reason;
+
+    // Time in seconds. start is from an arbitrary epoch
+    double start;
+    double duration;
+    double phase_time[static_cast<size_t>(GCPhase::COUNT)];
+
+    // Bytes allocated since last GC
+    size_t allocated;
+    // Bytes copied into survivor space
+    size_t copied;
+    // Bytes promoted into tenured space
+    size_t promoted;
+    // Bytes reclaimed
+    size_t freed;
+
+    SpaceUsage before;
+    SpaceUsage after;
+};
+
+struct HeapStatistics {
+    static const size_t kMaxAge = 256;
+
+    // Objects that survive more than this number of GCs will be promoted in next GC
+    uint8_t tenuring_threshold;
+    // Bytes of objects remaining in survivor space after last GC, by their age (# of GCs survived)
+    size_t age_histogram[kMaxAge];
+
+    // Average fraction of young objects surviving a minor GC
+    double survival_rate;
+    // Predicted pause of next minor GC with current eden size, and of a major GC
+    // started at the old generation limit, in seconds
+    double predicted_minor_pause;
+    double predicted_major_pause;
+    // Major GC is started once tenured and large objects exceed this number of bytes
+    size_t old_generation_limit;
+
+    // Cumulative counters since the heap is created
+    uint64_t minor_count;
+    uint64_t major_count;
+    uint64_t mixed_count;
+    double minor_time;
+    double major_time;
+    double mixed_time;
+    double max_pause;
+    size_t allocated;
+    size_t copied;
+    size_t promoted;
+    size_t freed;
+};
+
+// Called at the end of each GC
+class GCEventListener {
+  public:
+    virtual void operator()(const GCEvent& event) = 0;
+};
+
+// Called at the end of a GC when the heap is still larger than the soft heap limit.
+// Listeners may drop references, e.g. to shrink caches, but must not allocate GC objects
+class MemoryPressureListener {
+  public:
+    virtual void operator()(size_t used, size_t limit) = 0;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,35 @@
+#include "String.h"
+
+#include <cstring>
+
+using namespace norlit::gc;
+
+void String::Append(const char* str) {
+    BufferBase::Append(str, strlen(str));
+}
+
+uintptr_t String::HashCode() {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    const char* data = CStr();
+    for (size_t i = 0; i < Length(); i++) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return static_cast<uintptr_t>(hash);
+}
+
+bool String::Equals(const Handle<Object>& object) {
+    Handle<String> str = object.DynamicCastTo<String>();
+    return str && str->Length() == Length() && !memcmp(str->CStr(), CStr(), Length());
+}
+
+Handle<String> String::New(const char* data, size_t size) {
+    Handle<String> str = new String();
+    str->Append(data, size);
+    return str;
+}
+
+Handle<String> String::New(const char* str) {
+    return New(str, strlen(str));
+}
@@ -0,0 +1,73 @@
+#ifndef NORLIT_GC_STRING_H
+#define NORLIT_GC_STRING_H
+
+#include "Vector.h"
+
+namespace norlit {
+namespace gc {
+
+// Growable byte string. Contents are always NUL terminated, but may contain NUL
+class String : public detail::BufferBase {
+    String() {}
+
+  public:
+    const char* CStr() {
+        const char* data = BufferBase::Data();
+        return data ? data : "";
+    }
+
+    char* Data() {
+        return BufferBase::Data();
+    }
+
+    char& At(size_t index) {
+        return BufferBase::Data()[index];
+    }
+
+    size_t Length() {
+        return Size();
+    }
+
+    size_t Capacity() {
+        return BufferBase::Capacity();
+    }
+
+    // Data must not point into the heap
+    void Append(const char* data, size_t size) {
+        BufferBase::Append(data, size);
+    }
+
+    void Append(const char* str);
+
+    void Append(char c) {
+        BufferBase::Append(&c, 1);
+    }
+
+    void Append(const Handle<String>& str) {
+        BufferBase::Append(str);
+    }
+
+    void Reserve(size_t capacity) {
+        BufferBase::Reserve(capacity);
+    }
+
+    // New characters are NUL
+    void Resize(size_t length) {
+        BufferBase::Resize(length);
+    }
+
+    void Clear() {
+        BufferBase::Resize(0);
+    }
+
+    virtual uintptr_t HashCode() override;
+    virtual bool Equals(const Handle<Object>& object) override;
+
+    static Handle<String> New(const char* data, size_t size);
+    static Handle<String> New(const char* str = "");
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,39 @@
+#include "Value.h"
+
+using namespace norlit::gc;
+
+namespace {
+
+// Doubles that cannot be encoded in a tagged pointer
+class BoxedDouble final : public Object {
+  public:
+    double value;
+
+    BoxedDouble(double value) :value(value) {}
+
+    virtual uintptr_t HashCode() override {
+        uintptr_t bits;
+        memcpy(&bits, &value, sizeof(bits) < sizeof(value) ? sizeof(bits) : sizeof(value));
+        return bits;
+    }
+
+    virtual bool Equals(const Handle<Object>& object) override {
+        return object && !object->IsTagged() && typeid(*object) == typeid(BoxedDouble) &&
+               static_cast<BoxedDouble*>(static_cast<Object*>(object))->value == value;
+    }
+};
+
+}
+
+Value* Value::BoxDouble(double value) {
+    return From(new BoxedDouble(value));
+}
+
+double Value::UnboxDouble(const Value* value) {
+    assert(IsBoxedDouble(value));
+    return static_cast<const BoxedDouble*>(static_cast<const Object*>(value))->value;
+}
+
+bool Value::IsBoxedDouble(const Value* value) {
+    return IsObject(value) && typeid(*value) == typeid(BoxedDouble);
+}
@@ -0,0 +1,139 @@
+#ifndef NORLIT_GC_VALUE_H
+#define NORLIT_GC_VALUE_H
+
+#include "Object.h"
+#include "Handle.h"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace norlit {
+namespace gc {
+
+// A reference slot that holds either an object or an immediate. Immediates are
+// tagged pointers, so GC skips them and they are never allocated. Value is never
+// instantiated; Value* is the encoded word, and is stored in Handle<Value>,
+// Array<Value> or fields like any other reference.
+//
+// Encoding, by low bits of the word:
+//   000  object, or null
+//   011  integer in the upper bits
+//   111  false (0) or true (1) in the upper bits
+//   100  +0.0 (0) or -0.0 (1) in the upper bits
+//   x01, x10  double rotated left by 3 bits, for doubles whose exponent is in
+//        [-511, 512], i.e. magnitudes of about 1e-154 to 1e154. The two top exponent bits differ for them, so low bits
+//        are never 000 or x11. Other doubles are boxed.
+// On 32-bit platforms all non-zero doubles are boxed.
+class Value : public Object {
+    Value() = delete;
+
+    static const uintptr_t kIntTag = 3;
+    static const uintptr_t kBoolTag = 7;
+    static const uintptr_t kZeroTag = 4;
+
+    static uintptr_t Bits(const Value* value) {
+        return reinterpret_cast<uintptr_t>(value);
+    }
+
+    static Value* FromBits(uintptr_t bits) {
+        return reinterpret_cast<Value*>(bits);
+    }
+
+    static Value* BoxDouble(double value);
+    static double UnboxDouble(const Value* value);
+    static bool IsBoxedDouble(const Value* value);
+
+  public:
+    // Integers with at most kIntBits bits, i.e. 61 bits on 64-bit platforms
+    static const int kIntBits = sizeof(uintptr_t) * 8 - 3;
+    static const intptr_t kMinInt = -(static_cast<intptr_t>(1) << (kIntBits - 1));
+    static const intptr_t kMaxInt = (static_cast<intptr_t>(1) << (kIntBits - 1)) - 1;
+
+    static Value* Null() {
+        return nullptr;
+    }
+
+    static Value* Int(intptr_t value) {
+        if (value < kMinInt || value > kMaxInt) {
+            throw std::invalid_argument{ "Integer is too large for Value" };
+        }
+        return FromBits(static_cast<uintptr_t>(value) << 3 | kIntTag);
+    }
+
+    static Value* Bool(bool value) {
+        return FromBits(static_cast<uintptr_t>(value) << 3 | kBoolTag);
+    }
+
+    // Allocates a box for doubles that cannot be immediates
+    static Handle<Value> Double(double value) {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        if (!(bits << 1)) {
+            return FromBits(static_cast<uintptr_t>(bits >> 63) << 3 | kZeroTag);
+        }
+        if (sizeof(uintptr_t) == 8 && ((bits >> 61 & 3) == 1 || (bits >> 61 & 3) == 2)) {
+            return FromBits(static_cast<uintptr_t>(bits << 3 | bits >> 61));
+        }
+        return BoxDouble(value);
+    }
+
+    static Value* From(Object* object) {
+        return static_cast<Value*>(object);
+    }
+
+    static bool IsNull(const Value* value) {
+        return !value;
+    }
+
+    static bool IsInt(const Value* value) {
+        return (Bits(value) & 7) == kIntTag;
+    }
+
+    static bool IsBool(const Value* value) {
+        return (Bits(value) & 7) == kBoolTag;
+    }
+
+    static bool IsDouble(const Value* value) {
+        uintptr_t tag = Bits(value) & 3;
+        return tag == 1 || tag == 2 || (Bits(value) & 7) == kZeroTag || IsBoxedDouble(value);
+    }
+
+    // Not null and not an immediate
+    static bool IsObject(const Value* value) {
+        return value && !value->IsTagged();
+    }
+
+    static intptr_t ToInt(const Value* value) {
+        assert(IsInt(value));
+        return static_cast<intptr_t>(Bits(value)) >> 3;
+    }
+
+    static bool ToBool(const Value* value) {
+        assert(IsBool(value));
+        return Bits(value) >> 3;
+    }
+
+    static double ToDouble(const Value* value) {
+        uint64_t bits = Bits(value);
+        if ((bits & 7) == kZeroTag) {
+            bits = (bits >> 3) << 63;
+        } else if ((bits & 3) == 1 || (bits & 3) == 2) {
+            bits = bits >> 3 | bits << 61;
+        } else {
+            return UnboxDouble(value);
+        }
+        double result;
+        memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+
+    static Object* ToObject(const Value* value) {
+        assert(!value || !value->IsTagged());
+        return const_cast<Value*>(value);
+    }
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,173 @@
+#include "Vector.h"
+#include "Heap.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace norlit::gc;
+using namespace norlit::gc::detail;
+
+namespace {
+
+// Growth factor of storage, so appending is amortized constant time
+size_t GrowCapacity(size_t capacity, size_t required) {
+    return std::max(required, std::max(capacity * 2, static_cast<size_t>(8)));
+}
+
+}
+
+VectorBase* VectorBase::Reserve(size_t capacity) {
+    if (capacity <= Capacity()) {
+        return this;
+    }
+    capacity = GrowCapacity(Capacity(), capacity);
+
+    if (storage) {
+        Object* moved = Heap::ResizeLargeObject(storage, ArrayBase::SizeOf(capacity));
+        if (moved) {
+            // Pages added by remapping are zero-filled, so new slots are already null.
+            // Reference count of storage moves with it
+            storage = static_cast<ArrayBase*>(moved);
+            storage->length = capacity;
+            return this;
+        }
+    }
+
+    Handle<VectorBase> self = this;
+    ArrayBase* fresh = Array<Object>::New(capacity);
+    ArrayBase* old = self->storage;
+    if (old) {
+        fresh->PutRange(0, old->slots, self->length);
+        // Old storage is garbage now. Clear it, so it does not keep elements alive
+        // until it is collected
+        old->FillRange(0, nullptr, self->length);
+    }
+    self->WriteBarrier(&self->storage, fresh);
+    return self;
+}
+
+void VectorBase::Push(Object* obj) {
+    if (length < Capacity()) {
+        storage->Put(length++, obj);
+        return;
+    }
+    Handle<Object> element = obj;
+    VectorBase* self = Grow(1);
+    self->storage->Put(self->length++, element);
+}
+
+Object* VectorBase::Pop() {
+    Object* obj = storage->Get(--length);
+    storage->Put(length, nullptr);
+    return obj;
+}
+
+void VectorBase::Resize(size_t newLength) {
+    if (newLength < length) {
+        // Slots past length are kept null
+        storage->FillRange(newLength, nullptr, length - newLength);
+        length = newLength;
+        return;
+    }
+    VectorBase* self = Reserve(newLength);
+    self->length = newLength;
+}
+
+void VectorBase::Append(const Handle<ArrayBase>& array, size_t index, size_t count) {
+    if (!count) {
+        return;
+    }
+    VectorBase* self = Grow(count);
+    self->storage->PutRange(self->length, &array->slots[index], count);
+    self->length += count;
+}
+
+void VectorBase::Append(const Handle<VectorBase>& vector) {
+    size_t count = vector->length;
+    if (!count) {
+        return;
+    }
+    VectorBase* self = Grow(count);
+    // Vector may be self
+    self->storage->PutRange(self->length, vector->storage->slots, count);
+    self->length += count;
+}
+
+void VectorBase::IterateField(const FieldIterator& iter) {
+    iter(&storage);
+}
+
+void* Buffer::operator new(size_t size, size_t capacity, bool) {
+    return Object::operator new(SizeOf(capacity));
+}
+
+void Buffer::operator delete(void*, size_t, bool) {
+    assert(0);
+}
+
+BufferBase* BufferBase::Reserve(size_t size) {
+    if (size <= Capacity()) {
+        return this;
+    }
+    // One more byte for the terminating zero
+    size_t capacity = GrowCapacity(Capacity(), size) + 1;
+
+    if (storage) {
+        Object* moved = Heap::ResizeLargeObject(storage, Buffer::SizeOf(capacity));
+        if (moved) {
+            storage = static_cast<Buffer*>(moved);
+            storage->capacity = capacity;
+            return this;
+        }
+    }
+
+    Handle<BufferBase> self = this;
+    Buffer* fresh = new(capacity, false) Buffer(capacity);
+    if (self->storage) {
+        memcpy(fresh->Data(), self->storage->Data(), self->length + 1);
+    } else {
+        fresh->Data()[0] = 0;
+    }
+    self->WriteBarrier(&self->storage, fresh);
+    return self;
+}
+
+void BufferBase::Append(const void* data, size_t size) {
+    BufferBase* self = Grow(size);
+    if (!self->storage) {
+        return;
+    }
+    char* end = self->storage->Data() + self->length;
+    memcpy(end, data, size);
+    end[size] = 0;
+    self->length += size;
+}
+
+void BufferBase::Append(const Handle<BufferBase>& buffer) {
+    size_t size = buffer->length;
+    BufferBase* self = Grow(size);
+    if (!self->storage) {
+        return;
+    }
+    char* end = self->storage->Data() + self->length;
+    // Buffer may be self
+    memmove(end, buffer->storage->Data(), size);
+    end[size] = 0;
+    self->length += size;
+}
+
+void BufferBase::Resize(size_t size) {
+    BufferBase* self = this;
+    if (size > length) {
+        self = Grow(size - length);
+        memset(self->storage->Data() + self->length, 0, size - self->length);
+    }
+    if (self->storage) {
+        self->storage->Data()[size] = 0;
+    }
+    self->length = size;
+}
+
+void BufferBase::IterateField(const FieldIterator& iter) {
+    iter(&storage);
+}
@@ -0,0 +1,257 @@
+#ifndef NORLIT_GC_VECTOR_H
+#define NORLIT_GC_VECTOR_H
+
+#include "Array.h"
+
+#include <type_traits>
+
+namespace norlit {
+namespace gc {
+namespace detail {
+
+// Growable sequence of references. Storage is a private array that grows
+// geometrically. Once it is large enough to be in Large Object Space, it is
+// grown by remapping its pages rather than by copying.
+//
+// Methods that may allocate return the current location of the vector, since
+// GC can move it while they run.
+class VectorBase : public Object {
+    ArrayBase* storage = nullptr;
+    size_t length = 0;
+
+  protected:
+    VectorBase() {}
+
+    // Make room for capacity references in total
+    VectorBase* Reserve(size_t capacity);
+    // Make room for count more references
+    VectorBase* Grow(size_t count) {
+        if (length + count <= Capacity()) {
+            return this;
+        }
+        return Reserve(length + count);
+    }
+
+    void Put(size_t index, Object* obj) {
+        storage->Put(index, obj);
+    }
+
+    Object* Get(size_t index) {
+        return storage->Get(index);
+    }
+
+    size_t Length() {
+        return length;
+    }
+
+    size_t Capacity() {
+        return storage ? storage->Length() : 0;
+    }
+
+    void Push(Object* obj);
+    Object* Pop();
+    // New slots are null
+    void Resize(size_t length);
+    void Clear() {
+        Resize(0);
+    }
+    // Append count references of array starting at index
+    void Append(const Handle<ArrayBase>& array, size_t index, size_t count);
+    void Append(const Handle<VectorBase>& vector);
+
+    virtual void IterateField(const FieldIterator&) override;
+};
+
+// Bytes that hold no references. Storage of ValueVector and String
+class Buffer : public Object {
+    size_t capacity;
+    uint64_t data[1];
+
+    static void* operator new(size_t size) = delete;
+    static void* operator new(size_t size, size_t capacity, bool);
+    static void operator delete(void*, size_t, bool);
+    using Object::operator delete;
+
+    Buffer(size_t capacity) :capacity(capacity) {}
+
+    static size_t SizeOf(size_t capacity) {
+        return sizeof(Buffer) - sizeof(uint64_t) + capacity;
+    }
+
+    char* Data() {
+        return reinterpret_cast<char*>(data);
+    }
+
+    friend class BufferBase;
+};
+
+// Growable sequence of bytes, grown the same way as VectorBase. Contents are
+// always followed by a zero byte, so they can be used as a C string
+class BufferBase : public Object {
+    Buffer* storage = nullptr;
+    size_t length = 0;
+
+  protected:
+    BufferBase() {}
+
+    // Make room for size bytes in total
+    BufferBase* Reserve(size_t size);
+    BufferBase* Grow(size_t count) {
+        if (length + count <= Capacity()) {
+            return this;
+        }
+        return Reserve(length + count);
+    }
+
+    char* Data() {
+        return storage ? storage->Data() : nullptr;
+    }
+
+    size_t Size() {
+        return length;
+    }
+
+    size_t Capacity() {
+        // One byte is kept for the terminating zero
+        return storage ? storage->capacity - 1 : 0;
+    }
+
+    // Data must not point into the heap, as it may be moved by GC during growth
+    void Append(const void* data, size_t size);
+    void Append(const Handle<BufferBase>& buffer);
+    // New bytes are zero
+    void Resize(size_t size);
+
+    virtual void IterateField(const FieldIterator&) override;
+};
+
+}
+
+template<typename T>
+class Vector : public detail::VectorBase {
+    Vector() {}
+
+  public:
+    void Put(size_t index, const Handle<T>& obj) {
+        VectorBase::Put(index, obj);
+    }
+
+    Handle<T> Get(size_t index) {
+        return static_cast<T*>(VectorBase::Get(index));
+    }
+
+    size_t Length() {
+        return VectorBase::Length();
+    }
+
+    size_t Capacity() {
+        return VectorBase::Capacity();
+    }
+
+    void Push(const Handle<T>& obj) {
+        VectorBase::Push(obj);
+    }
+
+    Handle<T> Pop() {
+        return static_cast<T*>(VectorBase::Pop());
+    }
+
+    void Reserve(size_t capacity) {
+        VectorBase::Reserve(capacity);
+    }
+
+    void Resize(size_t length) {
+        VectorBase::Resize(length);
+    }
+
+    void Clear() {
+        VectorBase::Clear();
+    }
+
+    void Append(const Handle<Array<T>>& array) {
+        VectorBase::Append(array, 0, array->Length());
+    }
+
+    void Append(const Handle<Array<T>>& array, size_t index, size_t count) {
+        VectorBase::Append(array, index, count);
+    }
+
+    void Append(const Handle<Vector>& vector) {
+        VectorBase::Append(vector);
+    }
+
+    static Handle<Vector> New(size_t capacity = 0) {
+        Handle<Vector> vector = new Vector();
+        vector->Reserve(capacity);
+        return vector;
+    }
+};
+
+// Growable sequence of plain values, which are moved with memcpy
+template<typename T>
+class ValueVector : public detail::BufferBase {
+    static_assert(std::is_trivially_copyable<T>::value, "ValueVector elements must be trivially copyable");
+    static_assert(alignof(T) <= 8, "ValueVector elements must be at most 8-byte aligned");
+
+    ValueVector() {}
+
+  public:
+    T& At(size_t index) {
+        return reinterpret_cast<T*>(BufferBase::Data())[index];
+    }
+
+    T* Data() {
+        return reinterpret_cast<T*>(BufferBase::Data());
+    }
+
+    size_t Length() {
+        return Size() / sizeof(T);
+    }
+
+    size_t Capacity() {
+        return BufferBase::Capacity() / sizeof(T);
+    }
+
+    void Push(T value) {
+        BufferBase::Append(&value, sizeof(T));
+    }
+
+    T Pop() {
+        T value = At(Length() - 1);
+        BufferBase::Resize(Size() - sizeof(T));
+        return value;
+    }
+
+    // Data must not point into the heap
+    void Append(const T* data, size_t count) {
+        BufferBase::Append(data, sizeof(T) * count);
+    }
+
+    void Append(const Handle<ValueVector>& vector) {
+        BufferBase::Append(vector);
+    }
+
+    void Reserve(size_t capacity) {
+        BufferBase::Reserve(sizeof(T) * capacity);
+    }
+
+    // New elements are zero-filled
+    void Resize(size_t length) {
+        BufferBase::Resize(sizeof(T) * length);
+    }
+
+    void Clear() {
+        BufferBase::Resize(0);
+    }
+
+    static Handle<ValueVector> New(size_t capacity = 0) {
+        Handle<ValueVector> vector = new ValueVector();
+        vector->Reserve(capacity);
+        return vector;
+    }
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,74 @@
+// Copies between large reference arrays in Large Object Space, once element
+// by element with Put and once with the bulk operations, which run the write
+// barrier once per range. Each half prints its own result.
+
+#include "Benchmark.h"
+#include "Array.h"
+#include "Handle.h"
+
+using namespace norlit::gc;
+
+namespace {
+
+const size_t kArrayLength = 100000;
+const int kRounds = 100;
+
+class Box : public Object {
+    long value;
+
+  public:
+    Box(long value) :value(value) {}
+
+    long Value() {
+        return value;
+    }
+};
+
+}
+
+int main(int argc, char** argv) {
+    double scale = bench::Scale(argc, argv);
+    int rounds = static_cast<int>(kRounds * scale);
+
+    Handle<Array<Box>> source = Array<Box>::New(kArrayLength);
+    for (size_t i = 0; i < kArrayLength; i++) {
+        Handle<Box> box = new Box(i);
+        source->Put(i, box);
+    }
+    Handle<Array<Box>> target = Array<Box>::New(kArrayLength);
+    Handle<Box> filler = new Box(-1);
+
+    {
+        bench::Benchmark benchmark("array_put");
+        for (int round = 0; round < rounds; round++) {
+            for (size_t i = 0; i < kArrayLength; i++) {
+                target->Put(i, source->Get(i));
+            }
+            for (size_t i = 0; i < kArrayLength; i++) {
+                target->Put(i, filler);
+            }
+        }
+        bench::Check(target->Get(kArrayLength - 1)->Value() == -1, "put elements");
+        benchmark.Finish();
+    }
+
+    {
+        bench::Benchmark benchmark("array_bulk");
+        for (int round = 0; round < rounds; round++) {
+            target->CopyRange(0, source, 0, kArrayLength);
+            target->Fill(filler);
+        }
+        bench::Check(target->Get(kArrayLength - 1)->Value() == -1, "bulk elements");
+        benchmark.Finish();
+    }
+
+    // Remaining bulk operations are checked, but not timed
+    target->CopyRange(0, source, 0, kArrayLength);
+    target->InsertRange(10, source, 0, 5);
+    bench::Check(target->Get(10)->Value() == 0 && target->Get(15)->Value() == 10, "inserted elements");
+    target->Sort([](Box* a, Box* b) { return a->Value() > b->Value(); });
+    bench::Check(target->Get(0)->Value() == static_cast<long>(kArrayLength - 6), "sorted elements");
+    Handle<Array<Box>> slice = Array<Box>::New(source, 100, 1000);
+    bench::Check(slice->Get(0)->Value() == 100, "sliced elements");
+    return 0;
+}
@@ -0,0 +1,109 @@
+#ifndef NORLIT_GC_BENCH_BENCHMARK_H
+#define NORLIT_GC_BENCH_BENCHMARK_H
+
+#include "Heap.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace norlit {
+namespace gc {
+namespace bench {
+
+// Records every GC pause while the benchmark runs, and prints a single line
+// of JSON with allocation throughput, pause percentiles and peak RSS on Finish()
+class Benchmark : public GCEventListener {
+    const char* name;
+    std::vector<double> minorPauses;
+    std::vector<double> majorPauses;
+    std::chrono::steady_clock::time_point start;
+    size_t allocatedBefore;
+
+    static double Percentile(std::vector<double>& pauses, double percentile) {
+        if (pauses.empty()) {
+            return 0;
+        }
+        std::sort(pauses.begin(), pauses.end());
+        size_t index = static_cast<size_t>(percentile * (pauses.size() - 1) + 0.5);
+        return pauses[index] * 1000;
+    }
+
+    static long PeakRss() {
+#ifdef _WIN32
+        return 0;
+#else
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        // In kilobytes on Linux
+        return usage.ru_maxrss;
+#endif
+    }
+
+  public:
+    Benchmark(const char* name) :name(name) {
+        // Reserve so recording a pause never allocates in the middle of a benchmark
+        minorPauses.reserve(1 << 16);
+        majorPauses.reserve(1 << 12);
+        Heap::SetEventListener(this);
+        allocatedBefore = Heap::Statistics().allocated;
+        start = std::chrono::steady_clock::now();
+    }
+
+    ~Benchmark() {
+        Heap::SetEventListener(nullptr);
+    }
+
+    virtual void operator()(const GCEvent& event) override {
+        (event.type == GCType::MINOR ? minorPauses : majorPauses).push_back(event.duration);
+    }
+
+    void Finish() {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        Heap::SetEventListener(nullptr);
+
+        const HeapStatistics& stats = Heap::Statistics();
+        double allocated = static_cast<double>(stats.allocated - allocatedBefore);
+        std::vector<double> all(minorPauses);
+        all.insert(all.end(), majorPauses.begin(), majorPauses.end());
+        double total = 0;
+        for (double pause : all) {
+            total += pause;
+        }
+
+        printf("{\"benchmark\": \"%s\", \"seconds\": %.6f, \"allocated_bytes\": %.0f, "
+               "\"alloc_mb_per_s\": %.3f, \"minor_gcs\": %zu, \"major_gcs\": %zu, "
+               "\"gc_seconds\": %.6f, \"pause_p50_ms\": %.4f, \"pause_p90_ms\": %.4f, "
+               "\"pause_p99_ms\": %.4f, \"pause_max_ms\": %.4f, \"major_pause_max_ms\": %.4f, "
+               "\"peak_rss_kb\": %ld}\n",
+               name, seconds, allocated, allocated / seconds / (1024 * 1024),
+               minorPauses.size(), majorPauses.size(), total,
+               Percentile(all, 0.5), Percentile(all, 0.9), Percentile(all, 0.99),
+               Percentile(all, 1), Percentile(majorPauses, 1), PeakRss());
+        fflush(stdout);
+    }
+};
+
+// Scale factor from the first command line argument, to make runs shorter or longer
+inline double Scale(int argc, char** argv) {
+    return argc > 1 ? atof(argv[1]) : 1;
+}
+
+inline void Check(bool condition, const char* message) {
+    if (!condition) {
+        fprintf(stderr, "Benchmark verification failed: %s\n", message);
+        exit(1);
+    }
+}
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,117 @@
+// Port of Hans Boehm's GCBench: builds binary trees top-down and bottom-up
+// while a long-lived tree and a large array stay alive.
+
+#include "Benchmark.h"
+#include "Array.h"
+#include "Handle.h"
+
+using namespace norlit::gc;
+
+namespace {
+
+const int kStretchTreeDepth = 16;
+const int kLongLivedTreeDepth = 14;
+const int kArraySize = 250000;
+const int kMinTreeDepth = 4;
+const int kMaxTreeDepth = 14;
+
+class Node : public Object {
+    Node* left = nullptr;
+    Node* right = nullptr;
+
+  public:
+    Handle<Node> Left() {
+        return left;
+    }
+
+    Handle<Node> Right() {
+        return right;
+    }
+
+    void SetLeft(const Handle<Node>& node) {
+        WriteBarrier(&left, node);
+    }
+
+    void SetRight(const Handle<Node>& node) {
+        WriteBarrier(&right, node);
+    }
+
+    virtual void IterateField(const FieldIterator& iter) override {
+        iter(&left);
+        iter(&right);
+    }
+};
+
+int TreeSize(int depth) {
+    return (1 << (depth + 1)) - 1;
+}
+
+int NumIters(int depth) {
+    return 2 * TreeSize(kStretchTreeDepth) / TreeSize(depth);
+}
+
+void Populate(int depth, const Handle<Node>& node) {
+    if (depth <= 0) {
+        return;
+    }
+    depth--;
+    Handle<Node> left = new Node();
+    node->SetLeft(left);
+    Handle<Node> right = new Node();
+    node->SetRight(right);
+    Populate(depth, left);
+    Populate(depth, right);
+}
+
+Handle<Node> MakeTree(int depth) {
+    if (depth <= 0) {
+        return new Node();
+    }
+    Handle<Node> left = MakeTree(depth - 1);
+    Handle<Node> right = MakeTree(depth - 1);
+    Handle<Node> node = new Node();
+    node->SetLeft(left);
+    node->SetRight(right);
+    return node;
+}
+
+int CountNodes(const Handle<Node>& node) {
+    if (!node) {
+        return 0;
+    }
+    return 1 + CountNodes(node->Left()) + CountNodes(node->Right());
+}
+
+}
+
+int main(int argc, char** argv) {
+    double scale = bench::Scale(argc, argv);
+    bench::Benchmark benchmark("gcbench");
+
+    // Stretch the memory space quickly
+    MakeTree(kStretchTreeDepth);
+
+    Handle<Node> longLived = new Node();
+    Populate(kLongLivedTreeDepth, longLived);
+
+    Handle<ValueArray<double>> array = ValueArray<double>::New(kArraySize);
+    for (int i = 0; i < kArraySize / 2; i++) {
+        array->At(i) = 1.0 / i;
+    }
+
+    for (int depth = kMinTreeDepth; depth <= kMaxTreeDepth; depth += 2) {
+        int iterations = static_cast<int>(NumIters(depth) * scale);
+        for (int i = 0; i < iterations; i++) {
+            Handle<Node> node = new Node();
+            Populate(depth, node);
+        }
+        for (int i = 0; i < iterations; i++) {
+            MakeTree(depth);
+        }
+    }
+
+    bench::Check(CountNodes(longLived) == TreeSize(kLongLivedTreeDepth), "long lived tree is intact");
+    bench::Check(array->At(1000) == 1.0 / 1000, "array is intact");
+    benchmark.Finish();
+    return 0;
+}
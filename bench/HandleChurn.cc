@@ -0,0 +1,58 @@
+// Creation, copy, move and destruction of handles, with few allocations.
+
+#include "Benchmark.h"
+#include "Handle.h"
+
+#include <utility>
+#include <vector>
+
+using namespace norlit::gc;
+
+namespace {
+
+const size_t kLiveHandles = 2000;
+const int kRounds = 500;
+
+class Box : public Object {
+    long value;
+
+  public:
+    Box(long value) :value(value) {}
+
+    long Value() {
+        return value;
+    }
+};
+
+}
+
+int main(int argc, char** argv) {
+    double scale = bench::Scale(argc, argv);
+    bench::Benchmark benchmark("handle_churn");
+
+    std::vector<Handle<Box>> handles;
+    handles.reserve(kLiveHandles);
+    for (size_t i = 0; i < kLiveHandles; i++) {
+        handles.emplace_back(new Box(i));
+    }
+
+    long rounds = static_cast<long>(kRounds * scale);
+    long sum = 0;
+    for (long round = 0; round < rounds; round++) {
+        for (size_t i = 0; i < kLiveHandles; i++) {
+            // Swap two handles through copies and moves, without allocating
+            size_t j = (i * 7 + round) % kLiveHandles;
+            Handle<Box> copy = handles[i];
+            handles[i] = std::move(handles[j]);
+            handles[j] = copy;
+            sum += copy->Value();
+        }
+        // Allocate occasionally so GC keeps updating handles
+        Handle<Box> box = new Box(round % kLiveHandles);
+        handles[round % kLiveHandles] = box;
+    }
+
+    bench::Check(sum != 0, "handles are read");
+    benchmark.Finish();
+    return 0;
+}
@@ -0,0 +1,75 @@
+// Several linked lists built together, so their nodes are interleaved in
+// eden, and then walked one list at a time after they are promoted. Walks are
+// fast only if GC copied the nodes of each list next to each other.
+
+#include "Benchmark.h"
+#include "Array.h"
+#include "Handle.h"
+
+using namespace norlit::gc;
+
+namespace {
+
+const int kLists = 8;
+const int kListLength = 100000;
+const int kWalks = 50;
+
+class Node : public Object {
+    Node* next = nullptr;
+    long value;
+    // Pads nodes to a typical object size, so nodes of one list share fewer cache lines
+    char padding[24];
+
+  public:
+    Node(long value) :value(value) {}
+
+    void SetNext(const Handle<Node>& node) {
+        WriteBarrier(&next, node);
+    }
+
+    // Plain pointer walk, which is only valid while no object is allocated
+    static long Sum(Node* node) {
+        long sum = 0;
+        for (; node; node = node->next) {
+            sum += node->value;
+        }
+        return sum;
+    }
+
+    virtual void IterateField(const FieldIterator& iter) override {
+        iter(&next);
+    }
+};
+
+}
+
+int main(int argc, char** argv) {
+    double scale = bench::Scale(argc, argv);
+    long length = static_cast<long>(kListLength * scale);
+    Handle<Array<Node>> heads = Array<Node>::New(kLists);
+    Handle<Array<Node>> tails = Array<Node>::New(kLists);
+    for (long i = 0; i < length; i++) {
+        for (int list = 0; list < kLists; list++) {
+            Handle<Node> node = new Node(i);
+            if (i) {
+                tails->Get(list)->SetNext(node);
+            } else {
+                heads->Put(list, node);
+            }
+            tails->Put(list, node);
+        }
+    }
+    // Promote the rest of the lists, so the walks see the layout GC chose. Only
+    // the walks are timed
+    Heap::MajorGC();
+    bench::Benchmark benchmark("interleaved_lists");
+
+    long expected = length * (length - 1) / 2;
+    for (int walk = 0; walk < kWalks; walk++) {
+        for (int list = 0; list < kLists; list++) {
+            bench::Check(Node::Sum(heads->Get(list)) == expected, "list is intact");
+        }
+    }
+    benchmark.Finish();
+    return 0;
+}
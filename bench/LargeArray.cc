@@ -0,0 +1,68 @@
+// Large reference arrays in Large Object Space that are continuously
+// updated with young objects, together with short-lived large value arrays.
+
+#include "Benchmark.h"
+#include "Array.h"
+#include "Handle.h"
+
+#include <random>
+
+using namespace norlit::gc;
+
+namespace {
+
+const size_t kArrayLength = 100000;
+const int kSteps = 2000000;
+const int kReplaceInterval = 200000;
+
+class Box : public Object {
+    long value;
+
+  public:
+    Box(long value) :value(value) {}
+
+    long Value() {
+        return value;
+    }
+};
+
+}
+
+int main(int argc, char** argv) {
+    double scale = bench::Scale(argc, argv);
+    bench::Benchmark benchmark("large_array");
+
+    std::mt19937 random(42);
+    Handle<Array<Box>> array = Array<Box>::New(kArrayLength);
+    for (size_t i = 0; i < kArrayLength; i++) {
+        Handle<Box> box = new Box(i);
+        array->Put(i, box);
+    }
+
+    long steps = static_cast<long>(kSteps * scale);
+    for (long i = 0; i < steps; i++) {
+        size_t index = random() % kArrayLength;
+        Handle<Box> box = new Box(index);
+        array->Put(index, box);
+
+        if (i % 1024 == 0) {
+            Handle<ValueArray<double>> values = ValueArray<double>::New(1024 + random() % 8192);
+            values->At(0) = i;
+        }
+
+        if (i % kReplaceInterval == 0) {
+            // Copy into a fresh large array, so the old one becomes garbage
+            Handle<Array<Box>> copy = Array<Box>::New(kArrayLength);
+            for (size_t j = 0; j < kArrayLength; j++) {
+                copy->Put(j, array->Get(j));
+            }
+            array = copy;
+        }
+    }
+
+    for (size_t i = 0; i < kArrayLength; i++) {
+        bench::Check(array->Get(i)->Value() == static_cast<long>(i), "array is intact");
+    }
+    benchmark.Finish();
+    return 0;
+}
@@ -0,0 +1,69 @@
+// A queue of fixed length that keeps appending new nodes and dropping old
+// ones. Nodes live long enough to be promoted, so tenured space churns and
+// major GCs are exercised.
+
+#include "Benchmark.h"
+#include "Handle.h"
+
+using namespace norlit::gc;
+
+namespace {
+
+const int kLiveNodes = 100000;
+const int kSteps = 4000000;
+
+class Node : public Object {
+    Node* next = nullptr;
+    long value;
+
+  public:
+    Node(long value) :value(value) {}
+
+    long Value() {
+        return value;
+    }
+
+    Handle<Node> Next() {
+        return next;
+    }
+
+    void SetNext(const Handle<Node>& node) {
+        WriteBarrier(&next, node);
+    }
+
+    virtual void IterateField(const FieldIterator& iter) override {
+        iter(&next);
+    }
+};
+
+}
+
+int main(int argc, char** argv) {
+    double scale = bench::Scale(argc, argv);
+    bench::Benchmark benchmark("list_churn");
+
+    Handle<Node> head = new Node(0);
+    Handle<Node> tail = head;
+    long next = 1;
+    for (; next < kLiveNodes; next++) {
+        Handle<Node> node = new Node(next);
+        tail->SetNext(node);
+        tail = node;
+    }
+
+    long steps = static_cast<long>(kSteps * scale);
+    for (long i = 0; i < steps; i++, next++) {
+        Handle<Node> node = new Node(next);
+        tail->SetNext(node);
+        tail = node;
+        head = head->Next();
+    }
+
+    long expected = next - kLiveNodes;
+    for (Handle<Node> node = head; node; node = node->Next(), expected++) {
+        bench::Check(node->Value() == expected, "list is intact");
+    }
+    bench::Check(expected == next, "list has the right length");
+    benchmark.Finish();
+    return 0;
+}
@@ -0,0 +1,111 @@
+// Page-aligned I/O buffers that never move, and tenured buffers pinned for a
+// while, used next to a churning list whose nodes are promoted so major GCs
+// run while buffers are pinned. Buffer addresses are checked not to change.
+
+#include "Benchmark.h"
+#include "Array.h"
+#include "Handle.h"
+#include "Pinned.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+using namespace norlit::gc;
+
+namespace {
+
+const size_t kBufferCount = 64;
+const size_t kBufferSize = 16384;
+const size_t kAlignment = 4096;
+const int kLiveNodes = 50000;
+const int kSteps = 2000000;
+const int kReplaceInterval = 1000;
+const int kPinSteps = 20000;
+
+class Node : public Object {
+    Node* next = nullptr;
+    long value;
+
+  public:
+    Node(long value) :value(value) {}
+
+    Handle<Node> Next() {
+        return next;
+    }
+
+    void SetNext(const Handle<Node>& node) {
+        WriteBarrier(&next, node);
+    }
+
+    virtual void IterateField(const FieldIterator& iter) override {
+        iter(&next);
+    }
+};
+
+typedef ValueArray<uint8_t> Bytes;
+
+bool Aligned(const void* data) {
+    return (reinterpret_cast<uintptr_t>(data) & (kAlignment - 1)) == 0;
+}
+
+}
+
+int main(int argc, char** argv) {
+    double scale = bench::Scale(argc, argv);
+    bench::Benchmark benchmark("pinned_buffers");
+
+    Handle<Array<Bytes>> buffers = Array<Bytes>::New(kBufferCount);
+    uint8_t* addresses[kBufferCount];
+    for (size_t i = 0; i < kBufferCount; i++) {
+        Handle<Bytes> buffer = Bytes::NewPinned(kBufferSize, kAlignment);
+        std::fill(buffer->Data(), buffer->Data() + kBufferSize, static_cast<uint8_t>(i));
+        buffers->Put(i, buffer);
+        addresses[i] = buffer->Data();
+    }
+    Handle<Node> header = Heap::NewPinned<Node>(-1);
+    Node* headerAddress = header;
+
+    Handle<Node> head = new Node(0);
+    Handle<Node> tail = head;
+    for (long i = 1; i < kLiveNodes; i++) {
+        Handle<Node> node = new Node(i);
+        tail->SetNext(node);
+        tail = node;
+    }
+
+    long steps = static_cast<long>(kSteps * scale);
+    for (long i = 0; i < steps;) {
+        // A tenured buffer only stays put while pinned
+        Handle<Bytes> staging = Bytes::NewTenured(kBufferSize);
+        Pinned<Bytes> pinned { staging };
+        uint8_t* data = pinned->Data();
+        for (int j = 0; j < kPinSteps && i < steps; j++, i++) {
+            Handle<Node> node = new Node(i);
+            tail->SetNext(node);
+            tail = node;
+            head = head->Next();
+
+            if (i % kReplaceInterval == 0) {
+                // The replaced buffer becomes garbage in Large Object Space
+                size_t index = i / kReplaceInterval % kBufferCount;
+                memcpy(data, addresses[index], kBufferSize);
+                Handle<Bytes> buffer = Bytes::NewPinned(kBufferSize, kAlignment);
+                bench::Check(Aligned(buffer->Data()), "buffer is aligned");
+                memcpy(buffer->Data(), data, kBufferSize);
+                buffers->Put(index, buffer);
+                addresses[index] = buffer->Data();
+            }
+        }
+        bench::Check(pinned->Data() == data, "pinned buffer did not move");
+    }
+
+    for (size_t i = 0; i < kBufferCount; i++) {
+        Handle<Bytes> buffer = buffers->Get(i);
+        bench::Check(buffer->Data() == addresses[i], "pinned buffer did not move");
+        bench::Check(buffer->At(kBufferSize - 1) == static_cast<uint8_t>(i), "buffer contents");
+    }
+    bench::Check(header == headerAddress, "pinned object did not move");
+    benchmark.Finish();
+    return 0;
+}
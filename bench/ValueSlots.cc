@@ -0,0 +1,97 @@
+// A large array of numbers that is continuously overwritten, once with every
+// number boxed in an object and once with Value immediates, which are only
+// boxed for doubles out of the immediate range. Each half prints its own result.
+// The immediate half is much faster, so it runs kImmediateRounds times as many
+// steps to give stable timings; compare seconds per step.
+
+#include "Benchmark.h"
+#include "Array.h"
+#include "Handle.h"
+#include "Value.h"
+
+#include <random>
+
+using namespace norlit::gc;
+
+namespace {
+
+const size_t kArrayLength = 100000;
+const int kSteps = 1000000;
+// One in kHugeInterval doubles is too large to be an immediate
+const int kHugeInterval = 64;
+const int kImmediateRounds = 8;
+
+class Box : public Object {
+    double value;
+
+  public:
+    Box(double value) :value(value) {}
+
+    double Get() {
+        return value;
+    }
+};
+
+double Sum(const Handle<Array<Box>>& array) {
+    double sum = 0;
+    for (size_t i = 0; i < kArrayLength; i++) {
+        sum += array->Get(i)->Get();
+    }
+    return sum;
+}
+
+double Sum(const Handle<Array<Value>>& array) {
+    double sum = 0;
+    for (size_t i = 0; i < kArrayLength; i++) {
+        Value* value = array->Get(i);
+        sum += Value::IsInt(value) ? Value::ToInt(value) : Value::ToDouble(value);
+    }
+    return sum;
+}
+
+// Integers and doubles alternate. Both halves store the same numbers to the same
+// indices, so their sums are equal
+double NumberAt(long step) {
+    if (step % 2 == 0) {
+        return static_cast<double>(step);
+    }
+    return step % kHugeInterval == 1 ? 1e200 : step * 0.25;
+}
+
+}
+
+int main(int argc, char** argv) {
+    double scale = bench::Scale(argc, argv);
+    long steps = static_cast<long>(kSteps * scale);
+    double boxedSum;
+
+    {
+        bench::Benchmark benchmark("value_boxed");
+        std::mt19937 random(42);
+        Handle<Array<Box>> array = Array<Box>::New(kArrayLength);
+        for (long i = 0; i < steps; i++) {
+            Handle<Box> box = new Box(NumberAt(i));
+            array->Put(i < static_cast<long>(kArrayLength) ? i : random() % kArrayLength, box);
+        }
+        boxedSum = Sum(array);
+        benchmark.Finish();
+    }
+
+    {
+        bench::Benchmark benchmark("value_immediate");
+        std::mt19937 random(42);
+        Handle<Array<Value>> array = Array<Value>::New(kArrayLength);
+        for (int round = 0; round < kImmediateRounds; round++) {
+            for (long i = 0; i < steps; i++) {
+                double number = NumberAt(i);
+                Handle<Value> value = i % 2 == 0 ? Handle<Value>(Value::Int(static_cast<intptr_t>(number))) : Value::Double(number);
+                array->Put(i < static_cast<long>(kArrayLength) ? i : random() % kArrayLength, value);
+            }
+            if (round == 0) {
+                bench::Check(Sum(array) == boxedSum, "immediates hold the same numbers");
+            }
+        }
+        benchmark.Finish();
+    }
+    return 0;
+}
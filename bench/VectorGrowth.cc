@@ -0,0 +1,69 @@
+// Vectors, value vectors and strings that grow from empty to large sizes,
+// so their storage moves from young space into Large Object Space and keeps
+// growing there by remapping.
+
+#include "Benchmark.h"
+#include "Handle.h"
+#include "String.h"
+#include "Vector.h"
+
+#include <cstdio>
+
+using namespace norlit::gc;
+
+namespace {
+
+const size_t kVectorLength = 200000;
+const int kRounds = 10;
+
+class Box : public Object {
+    long value;
+
+  public:
+    Box(long value) :value(value) {}
+
+    long Value() {
+        return value;
+    }
+};
+
+}
+
+int main(int argc, char** argv) {
+    double scale = bench::Scale(argc, argv);
+    bench::Benchmark benchmark("vector_growth");
+
+    int rounds = static_cast<int>(kRounds * scale);
+    for (int round = 0; round < rounds; round++) {
+        Handle<Vector<Box>> boxes = Vector<Box>::New();
+        for (size_t i = 0; i < kVectorLength; i++) {
+            Handle<Box> box = new Box(i);
+            boxes->Push(box);
+        }
+        // Appending a vector to itself stores the whole range with one barrier
+        boxes->Append(boxes);
+        for (size_t i = 0; i < kVectorLength / 2; i++) {
+            boxes->Pop();
+        }
+
+        Handle<ValueVector<double>> values = ValueVector<double>::New();
+        for (size_t i = 0; i < kVectorLength; i++) {
+            values->Push(i * 0.5);
+        }
+
+        Handle<String> text = String::New();
+        char number[24];
+        for (size_t i = 0; i < kVectorLength / 8; i++) {
+            int length = snprintf(number, sizeof(number), "%zu,", i);
+            text->Append(number, length);
+        }
+
+        bench::Check(boxes->Length() == kVectorLength * 3 / 2, "vector length");
+        bench::Check(boxes->Get(kVectorLength - 1)->Value() == static_cast<long>(kVectorLength - 1), "vector elements");
+        bench::Check(boxes->Get(kVectorLength + 7)->Value() == 7, "appended elements");
+        bench::Check(values->At(kVectorLength - 1) == (kVectorLength - 1) * 0.5, "value vector elements");
+        bench::Check(text->CStr()[0] == '0' && text->CStr()[text->Length() - 1] == ',', "string contents");
+    }
+    benchmark.Finish();
+    return 0;
+}
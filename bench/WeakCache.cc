@@ -0,0 +1,103 @@
+// A cache whose entries reference their values weakly. A small ring of
+// strong references keeps recently used values alive; the rest are
+// collected and recreated on the next lookup.
+
+#include "Benchmark.h"
+#include "Array.h"
+#include "Handle.h"
+
+#include <random>
+
+using namespace norlit::gc;
+
+namespace {
+
+const size_t kBuckets = 8192;
+const size_t kRecent = 512;
+const int kLookups = 4000000;
+
+class Value : public Object {
+    long key;
+    // Some payload to make values non-trivial in size
+    long payload[6];
+
+  public:
+    Value(long key) :key(key) {
+        for (long& slot : payload) {
+            slot = key;
+        }
+    }
+
+    long Key() {
+        return key;
+    }
+};
+
+class Entry : public Object {
+    Value* value = nullptr;
+
+  public:
+    static long collected;
+
+    Handle<Value> Get() {
+        return value;
+    }
+
+    void Set(const Handle<Value>& newValue) {
+        WriteBarrier(&value, newValue);
+    }
+
+    virtual void IterateField(const FieldIterator& iter) override {
+        iter(&value, FieldIterator::weak);
+    }
+
+    virtual void NotifyWeakReferenceCollected(Object**) override {
+        collected++;
+    }
+};
+
+long Entry::collected = 0;
+
+}
+
+int main(int argc, char** argv) {
+    double scale = bench::Scale(argc, argv);
+    bench::Benchmark benchmark("weak_cache");
+
+    std::mt19937 random(42);
+    Handle<Array<Entry>> cache = Array<Entry>::New(kBuckets);
+    for (size_t i = 0; i < kBuckets; i++) {
+        Handle<Entry> entry = new Entry();
+        cache->Put(i, entry);
+    }
+    Handle<Array<Value>> recent = Array<Value>::New(kRecent);
+
+    long hits = 0;
+    long misses = 0;
+    long lookups = static_cast<long>(kLookups * scale);
+    for (long i = 0; i < lookups; i++) {
+        // Skewed keys, so some entries are hot
+        size_t key = random() % kBuckets;
+        if (random() % 2) {
+            key %= kBuckets / 16;
+        }
+        // Boxed lookup key, which is garbage right after the lookup
+        Handle<Value> probe = new Value(key);
+        Handle<Entry> entry = cache->Get(probe->Key());
+        Handle<Value> value = entry->Get();
+        if (value) {
+            bench::Check(value->Key() == static_cast<long>(key), "cached value matches key");
+            hits++;
+        } else {
+            value = new Value(key);
+            entry->Set(value);
+            misses++;
+        }
+        recent->Put(i % kRecent, value);
+    }
+
+    bench::Check(hits + misses == lookups, "all lookups are counted");
+    bench::Check(Entry::collected > 0, "weak references are collected");
+    benchmark.Finish();
+    return 0;
+}
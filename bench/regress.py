@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+"""Runs the GC benchmarks and compares results against a stored baseline.
+
+    regress.py run --bin-dir DIR --output FILE [--scale S] NAME...
+    regress.py compare BASELINE CURRENT
+
+Each benchmark prints a single JSON object on stdout. `run` collects them
+into a JSON list; `compare` exits with a non-zero status if any benchmark
+regressed by more than the tolerance.
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+
+# Relative tolerance and absolute slack for each metric. A metric regresses
+# when it moves in the bad direction by more than both of them.
+METRICS = [
+    # (name, higher_is_better, relative, absolute)
+    ("seconds", False, 0.15, 0.05),
+    ("alloc_mb_per_s", True, 0.15, 0.0),
+    ("pause_p99_ms", False, 0.15, 0.5),
+    ("pause_max_ms", False, 0.50, 2.0),
+    ("peak_rss_kb", False, 0.15, 4096),
+]
+
+
+def run(args):
+    results = []
+    for name in args.benchmarks:
+        binary = os.path.join(args.bin_dir, name)
+        if os.name == "nt":
+            binary += ".exe"
+        output = subprocess.run([binary, str(args.scale)], check=True,
+                                stdout=subprocess.PIPE, universal_newlines=True).stdout
+        for line in output.splitlines():
+            line = line.strip()
+            if line.startswith("{"):
+                result = json.loads(line)
+                results.append(result)
+                print("{:<14} {:>10.1f} MB/s  p99 {:>8.3f} ms  max {:>8.3f} ms  rss {:>8} KB".format(
+                    result["benchmark"], result["alloc_mb_per_s"], result["pause_p99_ms"],
+                    result["pause_max_ms"], result["peak_rss_kb"]))
+    with open(args.output, "w") as f:
+        json.dump(results, f, indent=2)
+        f.write("\n")
+    return 0
+
+
+def compare(args):
+    with open(args.baseline) as f:
+        baseline = {r["benchmark"]: r for r in json.load(f)}
+    with open(args.current) as f:
+        current = {r["benchmark"]: r for r in json.load(f)}
+
+    failed = False
+    for name, result in sorted(current.items()):
+        base = baseline.get(name)
+        if base is None:
+            print("{}: no baseline".format(name))
+            continue
+        for metric, higher_is_better, relative, absolute in METRICS:
+            old, new = base[metric], result[metric]
+            delta = old - new if higher_is_better else new - old
+            regressed = delta > old * relative and delta > absolute
+            change = (new - old) / old * 100 if old else 0
+            print("{:<14} {:<16} {:>12.3f} -> {:>12.3f} ({:+6.1f}%){}".format(
+                name, metric, old, new, change, "  REGRESSION" if regressed else ""))
+            failed |= regressed
+    return 1 if failed else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest="command")
+
+    run_parser = commands.add_parser("run")
+    run_parser.add_argument("--bin-dir", required=True)
+    run_parser.add_argument("--output", required=True)
+    run_parser.add_argument("--scale", type=float, default=1)
+    run_parser.add_argument("benchmarks", nargs="+")
+
+    compare_parser = commands.add_parser("compare")
+    compare_parser.add_argument("baseline")
+    compare_parser.add_argument("current")
+
+    args = parser.parse_args()
+    if args.command == "run":
+        return run(args)
+    if args.command == "compare":
+        return compare(args)
+    parser.print_help()
+    return 2
+
+
+if __name__ == "__main__":
+    sys.exit(main())
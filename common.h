@@ -11,7 +11,13 @@ enum class Space : uint8_t {
     SURVIVOR_SPACE,
     TENURED_SPACE,
     LARGE_OBJECT_SPACE,
-    STACK_SPACE
+    STACK_SPACE,
+    // Objects created by Heap::NewImmortal or loaded from a heap image. Never
+    // marked, moved or collected
+    IMMORTAL_SPACE,
+    // Objects created inside a Region. Not moved while the region is active, and
+    // either freed or moved into tenured space when it ends
+    REGION_SPACE
 };
 
 enum class Status : uint8_t {
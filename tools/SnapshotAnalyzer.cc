@@ -0,0 +1,351 @@
+// Offline analyzer for snapshots written by norlit::gc::HeapSnapshot.
+// Computes the dominator tree of the object graph (Cooper-Harvey-Kennedy),
+// and reports retained sizes of the largest objects and shallow sizes by type.
+//
+// Usage: SnapshotAnalyzer <snapshot> [number of entries to report]
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__GNUC__)
+#include <cxxabi.h>
+#endif
+
+namespace {
+
+const uint32_t kNone = UINT32_MAX;
+
+struct Node {
+    uint64_t address;
+    uint32_t type;
+    uint32_t size;
+    uint8_t space;
+    uint8_t age;
+    // Range of strong edges in Snapshot::edges
+    uint32_t edgeBegin;
+    uint32_t edgeEnd;
+};
+
+struct Snapshot {
+    std::vector<std::string> types;
+    // Node 0 is a virtual root pointing to all stack space objects
+    std::vector<Node> nodes;
+    // Targets are addresses while reading, and node indexes after Resolve()
+    std::vector<uint64_t> edges;
+    uint64_t weakEdges = 0;
+    uint64_t danglingEdges = 0;
+};
+
+class Reader {
+    FILE* file;
+
+  public:
+    Reader(FILE* file) :file(file) {}
+
+    template<typename T>
+    T Read() {
+        T value;
+        if (fread(&value, sizeof(T), 1, file) != 1) {
+            fprintf(stderr, "Unexpected end of snapshot\n");
+            exit(1);
+        }
+        return value;
+    }
+
+    std::string ReadString(size_t length) {
+        std::string value(length, '\0');
+        if (length && fread(&value[0], 1, length, file) != length) {
+            fprintf(stderr, "Unexpected end of snapshot\n");
+            exit(1);
+        }
+        return value;
+    }
+};
+
+const uint8_t kStackSpace = 4;
+
+std::string Demangle(const std::string& name) {
+#if defined(__GNUC__)
+    int status;
+    char* demangled = abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status);
+    if (demangled) {
+        std::string ret = demangled;
+        free(demangled);
+        return ret;
+    }
+#endif
+    return name;
+}
+
+const char* SpaceName(uint8_t space) {
+    static const char* const names[] = { "eden", "survivor", "tenured", "large object", "stack", "immortal", "region" };
+    return space < sizeof(names) / sizeof(names[0]) ? names[space] : "other";
+}
+
+void Load(FILE* file, Snapshot& snapshot) {
+    Reader reader(file);
+    if (reader.ReadString(8) != "NGCHEAP1" || reader.Read<uint32_t>() != 1) {
+        fprintf(stderr, "Not a heap snapshot or unsupported version\n");
+        exit(1);
+    }
+    reader.Read<uint32_t>();
+
+    snapshot.nodes.push_back(Node{ 0, kNone, 0, kStackSpace, 0, 0, 0 });
+    std::vector<uint64_t> roots;
+    while (true) {
+        char tag = reader.Read<char>();
+        if (tag == 'E') {
+            break;
+        } else if (tag == 'T') {
+            uint32_t id = reader.Read<uint32_t>();
+            uint32_t length = reader.Read<uint32_t>();
+            if (snapshot.types.size() <= id) {
+                snapshot.types.resize(id + 1);
+            }
+            snapshot.types[id] = Demangle(reader.ReadString(length));
+        } else if (tag == 'N') {
+            Node node;
+            node.address = reader.Read<uint64_t>();
+            node.type = reader.Read<uint32_t>();
+            node.size = reader.Read<uint32_t>();
+            node.space = reader.Read<uint8_t>();
+            node.age = reader.Read<uint8_t>();
+            uint32_t count = reader.Read<uint32_t>();
+            node.edgeBegin = static_cast<uint32_t>(snapshot.edges.size());
+            for (uint32_t i = 0; i < count; i++) {
+                uint64_t target = reader.Read<uint64_t>();
+                uint8_t flags = reader.Read<uint8_t>();
+                // Weak references do not retain objects
+                if (flags & 1) {
+                    snapshot.weakEdges++;
+                } else {
+                    snapshot.edges.push_back(target);
+                }
+            }
+            node.edgeEnd = static_cast<uint32_t>(snapshot.edges.size());
+            if (node.space == kStackSpace) {
+                roots.push_back(node.address);
+            }
+            snapshot.nodes.push_back(node);
+        } else {
+            fprintf(stderr, "Corrupted snapshot\n");
+            exit(1);
+        }
+    }
+
+    // Edges of the virtual root are appended at the end
+    snapshot.nodes[0].edgeBegin = static_cast<uint32_t>(snapshot.edges.size());
+    snapshot.edges.insert(snapshot.edges.end(), roots.begin(), roots.end());
+    snapshot.nodes[0].edgeEnd = static_cast<uint32_t>(snapshot.edges.size());
+}
+
+void Resolve(Snapshot& snapshot) {
+    std::unordered_map<uint64_t, uint32_t> index;
+    index.reserve(snapshot.nodes.size());
+    for (uint32_t i = 1; i < snapshot.nodes.size(); i++) {
+        index.emplace(snapshot.nodes[i].address, i);
+    }
+    for (uint64_t& edge : snapshot.edges) {
+        auto iter = index.find(edge);
+        if (iter == index.end()) {
+            snapshot.danglingEdges++;
+            edge = kNone;
+        } else {
+            edge = iter->second;
+        }
+    }
+}
+
+// Returns immediate dominator of each node, kNone if unreachable
+std::vector<uint32_t> Dominators(const Snapshot& snapshot, std::vector<uint32_t>& postorder) {
+    size_t count = snapshot.nodes.size();
+
+    // Iterative DFS for post order
+    std::vector<uint32_t> order(count, kNone);
+    std::vector<uint8_t> visited(count, 0);
+    std::vector<std::pair<uint32_t, uint32_t>> stack;
+    stack.emplace_back(0, snapshot.nodes[0].edgeBegin);
+    visited[0] = 1;
+    while (!stack.empty()) {
+        uint32_t node = stack.back().first;
+        uint32_t& edge = stack.back().second;
+        if (edge < snapshot.nodes[node].edgeEnd) {
+            uint64_t target = snapshot.edges[edge++];
+            if (target != kNone && !visited[target]) {
+                visited[target] = 1;
+                stack.emplace_back(static_cast<uint32_t>(target), snapshot.nodes[target].edgeBegin);
+            }
+        } else {
+            order[node] = static_cast<uint32_t>(postorder.size());
+            postorder.push_back(node);
+            stack.pop_back();
+        }
+    }
+
+    // Predecessors of reachable nodes
+    std::vector<uint32_t> predBegin(count + 1, 0);
+    for (uint32_t node : postorder) {
+        for (uint32_t i = snapshot.nodes[node].edgeBegin; i < snapshot.nodes[node].edgeEnd; i++) {
+            if (snapshot.edges[i] != kNone) {
+                predBegin[snapshot.edges[i] + 1]++;
+            }
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        predBegin[i + 1] += predBegin[i];
+    }
+    std::vector<uint32_t> preds(predBegin[count]);
+    std::vector<uint32_t> fill(predBegin.begin(), predBegin.end() - 1);
+    for (uint32_t node : postorder) {
+        for (uint32_t i = snapshot.nodes[node].edgeBegin; i < snapshot.nodes[node].edgeEnd; i++) {
+            if (snapshot.edges[i] != kNone) {
+                preds[fill[snapshot.edges[i]]++] = node;
+            }
+        }
+    }
+
+    std::vector<uint32_t> idom(count, kNone);
+    idom[0] = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        // Reverse post order, skipping the root
+        for (size_t i = postorder.size() - 1; i-- > 0;) {
+            uint32_t node = postorder[i];
+            uint32_t newIdom = kNone;
+            for (uint32_t j = predBegin[node]; j < predBegin[node + 1]; j++) {
+                uint32_t pred = preds[j];
+                if (idom[pred] == kNone) {
+                    continue;
+                }
+                if (newIdom == kNone) {
+                    newIdom = pred;
+                    continue;
+                }
+                uint32_t a = pred;
+                uint32_t b = newIdom;
+                while (a != b) {
+                    while (order[a] < order[b]) {
+                        a = idom[a];
+                    }
+                    while (order[b] < order[a]) {
+                        b = idom[b];
+                    }
+                }
+                newIdom = a;
+            }
+            if (idom[node] != newIdom) {
+                idom[node] = newIdom;
+                changed = true;
+            }
+        }
+    }
+    return idom;
+}
+
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <snapshot> [entries]\n", argv[0]);
+        return 1;
+    }
+    size_t entries = argc > 2 ? strtoul(argv[2], nullptr, 10) : 20;
+
+    FILE* file = fopen(argv[1], "rb");
+    if (!file) {
+        perror(argv[1]);
+        return 1;
+    }
+    Snapshot snapshot;
+    Load(file, snapshot);
+    fclose(file);
+    Resolve(snapshot);
+
+    std::vector<uint32_t> postorder;
+    std::vector<uint32_t> idom = Dominators(snapshot, postorder);
+
+    // Children are always before parents in post order
+    std::vector<uint64_t> retained(snapshot.nodes.size(), 0);
+    for (uint32_t node : postorder) {
+        retained[node] += snapshot.nodes[node].size;
+        if (node) {
+            retained[idom[node]] += retained[node];
+        }
+    }
+
+    printf("Objects: %zu, strong references: %zu, weak references: %llu, dangling references: %llu\n",
+           snapshot.nodes.size() - 1, snapshot.edges.size(),
+           static_cast<unsigned long long>(snapshot.weakEdges),
+           static_cast<unsigned long long>(snapshot.danglingEdges));
+
+    uint64_t spaceCount[256] = {};
+    uint64_t spaceSize[256] = {};
+    uint64_t unreachableCount = 0;
+    uint64_t unreachableSize = 0;
+    std::vector<uint64_t> typeCount(snapshot.types.size(), 0);
+    std::vector<uint64_t> typeSize(snapshot.types.size(), 0);
+    for (uint32_t i = 1; i < snapshot.nodes.size(); i++) {
+        const Node& node = snapshot.nodes[i];
+        spaceCount[node.space]++;
+        spaceSize[node.space] += node.size;
+        if (node.type < snapshot.types.size()) {
+            typeCount[node.type]++;
+            typeSize[node.type] += node.size;
+        }
+        if (idom[i] == kNone) {
+            unreachableCount++;
+            unreachableSize += node.size;
+        }
+    }
+
+    printf("\n%-16s %12s %16s\n", "Space", "Objects", "Bytes");
+    for (int space = 0; space < 256; space++) {
+        if (spaceCount[space]) {
+            printf("%-16s %12llu %16llu\n", SpaceName(static_cast<uint8_t>(space)),
+                   static_cast<unsigned long long>(spaceCount[space]),
+                   static_cast<unsigned long long>(spaceSize[space]));
+        }
+    }
+    printf("%-16s %12llu %16llu\n", "(unreachable)",
+           static_cast<unsigned long long>(unreachableCount),
+           static_cast<unsigned long long>(unreachableSize));
+
+    std::vector<uint32_t> types(snapshot.types.size());
+    for (uint32_t i = 0; i < types.size(); i++) {
+        types[i] = i;
+    }
+    std::sort(types.begin(), types.end(), [&](uint32_t a, uint32_t b) {
+        return typeSize[a] > typeSize[b];
+    });
+    printf("\nTypes by shallow size\n%12s %16s  %s\n", "Objects", "Bytes", "Type");
+    for (size_t i = 0; i < std::min(entries, types.size()); i++) {
+        printf("%12llu %16llu  %s\n", static_cast<unsigned long long>(typeCount[types[i]]),
+               static_cast<unsigned long long>(typeSize[types[i]]), snapshot.types[types[i]].c_str());
+    }
+
+    std::vector<uint32_t> objects;
+    for (uint32_t i = 1; i < snapshot.nodes.size(); i++) {
+        if (idom[i] != kNone && snapshot.nodes[i].space != kStackSpace) {
+            objects.push_back(i);
+        }
+    }
+    size_t top = std::min(entries, objects.size());
+    std::partial_sort(objects.begin(), objects.begin() + top, objects.end(), [&](uint32_t a, uint32_t b) {
+        return retained[a] > retained[b];
+    });
+    printf("\nObjects by retained size\n%18s %12s %16s %4s  %s\n", "Address", "Space", "Retained", "Age", "Type");
+    for (size_t i = 0; i < top; i++) {
+        const Node& node = snapshot.nodes[objects[i]];
+        printf("%#18llx %12s %16llu %4u  %s\n", static_cast<unsigned long long>(node.address),
+               SpaceName(node.space), static_cast<unsigned long long>(retained[objects[i]]), node.age,
+               node.type < snapshot.types.size() ? snapshot.types[node.type].c_str() : "?");
+    }
+    return 0;
+}